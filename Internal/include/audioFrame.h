@@ -2,246 +2,1620 @@
 #define audioQueue_H
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
 #include <concepts>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
 #include <print>
+#include <span>
 #include <thread>
 #include <type_traits>
 #include <vector>
 
-#include "samplerate.h"
+#include "audioResampler.h"
+#include "channelMatrix.h"
+#include "queueStorage.h"
+#include "sampleTypes.h"
+
+inline constexpr std::size_t cacheLineSize   = 64;
+inline constexpr std::size_t maxHoldChannels = 64;
+inline constexpr std::size_t maxPlanarChannels = 64;
+inline constexpr std::size_t maxHeldFrames   = 64;
+inline constexpr std::size_t gainRampFrames  = 256;
 
 template<typename T>
-concept audioType = std::same_as<T, short> || std::same_as<T, float>;
+concept audioType = std::same_as<T, short> || std::same_as<T, int24> || std::same_as<T, std::int32_t> || std::same_as<T, float> || std::same_as<T, double>;
+
+/**
+ * @brief Index policies, mapping the monotonic 64-bit queue indices to ring slots.
+ * 
+ * moduloIndex keeps the requested capacity, powerOfTwoIndex rounds it up and replaces the division by a mask.
+ */
+struct moduloIndex
+{
+    static constexpr std::size_t capacityFor(const std::size_t   requested)                              { return requested; }
+    static constexpr std::size_t slot       (const std::uint64_t index, const std::size_t capacity)     { return static_cast<std::size_t>(index % capacity); }
+};
+
+struct powerOfTwoIndex
+{
+    static constexpr std::size_t capacityFor(const std::size_t   requested)                              { return std::bit_ceil(requested); }
+    static constexpr std::size_t slot       (const std::uint64_t index, const std::size_t capacity)     { return static_cast<std::size_t>(index & (capacity - 1)); }
+};
+
+/**
+ * @brief Queue sizing in time units, converted to samples with the output sample rate and channel count.
+ *
+ * The fill level is kept under maximum, the capacity adds headroom on top of it so that the producer
+ * never writes right behind the block the consumer is reading. target is the fill level the rate
+ * controllers aim for.
+ */
+struct latencySettings
+{
+    std::chrono::milliseconds target;
+    std::chrono::milliseconds maximum;
+    std::chrono::milliseconds headroom;
+};
+
+/**
+ * @brief Ring storage layout. interleaved keeps frames contiguous, planar keeps one contiguous ring per channel
+ * and interleaves only when an interleaved reader asks for it. held copies nothing in : the queue keeps descriptors
+ * of producer-owned planar buffers, see audioQueue::hold.
+ */
+enum class sampleLayout : std::uint8_t
+{
+    interleaved,
+    planar,
+    held
+};
 
-template <audioType T>
+/**
+ * @brief Descriptor of a producer-owned planar buffer, read in place by a queue in the held layout.
+ *
+ * Channel c starts at data + c * channelStride. owner is not used by the queue, it is handed back
+ * to the release callback once every frame of the buffer has been read.
+ */
+template<typename T>
+struct heldFrame
+{
+    const T*    data          = nullptr;
+    std::size_t frames        = 0;
+    std::size_t channels      = 0;
+    std::size_t channelStride = 0;
+    std::size_t sampleRate    = 0;
+    void*       owner         = nullptr;
+};
+
+/**
+ * @brief What the consumer outputs for the frames it could not get from the queue.
+ */
+enum class underrunPolicy : std::uint8_t
+{
+    silence,
+    holdLast
+};
+
+/**
+ * @brief How push and waitForSpace / waitForData behave when the queue cannot serve the request yet.
+ *
+ * block sleeps on the opposite index with std::atomic::wait until it moves, deadline polls with a short
+ * backoff until the configured timeout expires, failFast returns at once.
+ */
+enum class waitMode : std::uint8_t
+{
+    failFast,
+    block,
+    deadline
+};
+
+/**
+ * @brief What push does with frames that do not fit in the queue, always applied to whole frames.
+ *
+ * dropNewest discards the incoming frames, dropOldest advances the head over the oldest buffered frames,
+ * block waits for the consumer according to the wait mode, grow enlarges the queue up to a bound.
+ */
+enum class overflowPolicy : std::uint8_t
+{
+    dropNewest,
+    dropOldest,
+    block,
+    grow
+};
+
+/**
+ * @brief Wait policies, how push and pop wait for the opposite thread.
+ *
+ * runtimeWait follows the waitMode set with setWaitMode. spinWait busy-polls until the wait timeout, for threads
+ * that must not be descheduled. futexWait sleeps in std::atomic::wait until the index moves, noWait never waits.
+ * Only the sleeping policies need the other side to notify, spinWait and noWait drop the fence and waiter check
+ * from every commit and consume.
+ */
+struct runtimeWait { static constexpr bool notifies = true;  };
+struct spinWait    { static constexpr bool notifies = false; };
+struct futexWait   { static constexpr bool notifies = true;  };
+struct noWait      { static constexpr bool notifies = false; };
+
+/**
+ * @brief Overflow policies, runtimeOverflow reads the policy set with setOverflowPolicy on every push,
+ * fixedOverflow compiles a single overflowPolicy in.
+ */
+struct runtimeOverflow {};
+
+template<overflowPolicy policy>
+struct fixedOverflow { static constexpr overflowPolicy value = policy; };
+
+/**
+ * @brief Underrun counters, written by the consumer and read by any reporting thread.
+ * primingFrames are the frames concealed while the jitter buffer fills up to its delay, they are not underruns.
+ */
+struct underrunStats
+{
+    std::uint64_t events;
+    std::uint64_t frames;
+    std::uint64_t primingFrames;
+};
+
+/**
+ * @brief Sender media time in the 100 ns units of NDI timecodes and timestamps.
+ */
+using mediaTicks = std::chrono::duration<std::int64_t, std::ratio<1, 10'000'000>>;
+inline constexpr mediaTicks untimed = mediaTicks::max();
+
+/**
+ * @brief Jitter buffer counters, written by the producer and read by any reporting thread.
+ */
+struct jitterStats
+{
+    std::uint64_t gapFrames;
+    std::uint64_t lateFrames;
+    std::uint64_t resyncs;
+};
+
+/**
+ * @brief A contiguous view over ring storage, split in at most two segments by the wrap point.
+ */
+template<typename T>
+struct ringRegion
+{
+    std::span<T> first;
+    std::span<T> second;
+
+    inline std::size_t size () const { return first.size() + second.size(); }
+    inline        bool empty() const { return first.empty(); }
+};
+
+/**
+ * @brief Single-producer single-consumer audio queue.
+ *
+ * The ring container, the slot mapping, the way each side waits and the overflow handling are policies resolved
+ * at compile time, the defaults keep the runtime-configurable behaviour of setWaitMode and setOverflowPolicy.
+ */
+template <audioType T, typename indexPolicy = moduloIndex, typename storagePolicy = heapStorage, typename waitPolicy = runtimeWait, typename overflowHandling = runtimeOverflow>
 class audioQueue 
 {
     private : //Class members
-              std::vector<T> queue;
+    using ringStorage = typename storagePolicy::template buffer<T>;
 
                 std::size_t  audioSampleRate;
                 std::size_t  channelNum;
-                std::size_t  inputDelay;
-                std::size_t  outputDelay;
-   std::atomic <std::size_t> head;
-   std::atomic <std::size_t> tail;                
-   std::atomic <std::size_t> elementCount;
+                std::size_t  outputChannelNum;
+                std::size_t  outputSampleRate;
+            latencySettings  latency;
+   std::atomic<std::size_t>  targetFill;
+                std::size_t  fillLimit;
+                std::size_t  latencyCapacity;
+                std::size_t  grownCapacity;
+                std::size_t  pendingCapacity;
+               sampleLayout  layout;
+                   waitMode  blocking;
+  std::chrono::microseconds  timeout;
+std::atomic<overflowPolicy>  overflow;
+                std::size_t  maxCapacity;
+std::atomic<underrunPolicy>  underrun;
+         std::atomic<float>  gainTarget;
+             audioResampler  resampler;
+                       bool  driftEnabled;
+                     double  driftMaxPpm;
+                     double  driftFill;
+                     double  driftIntegral;
+        std::atomic<double>  driftEstimate;
+          std::atomic<bool>  jitterEnabled;
+                 mediaTicks  nextTimestamp;
+
+    // Target latency tuning state, owned by the producer. Only the arrival jitter is read by other threads.
+    struct latencyTuner
+    {
+                       bool  enabled        = false;
+                     double  minimum        = 0.0;
+                     double  maximum        = 0.0;
+                     double  target         = 0.0;
+                     double  stableTime     = 0.0;
+                     double  lastBlock      = 0.0;
+std::chrono::steady_clock::time_point lastArrival;
+              std::uint64_t  seenUnderruns  = 0;
+              std::uint64_t  seenDrops      = 0;
+        std::atomic<double>  jitter         = 0.0;
+    }                        tuner;
+              channelMatrix  matrix;
+             std::vector<T>  conversionBuffer;
+         std::vector<float>  floatBuffer;
+             std::vector<T>  resampleBuffer;
+std::array<heldFrame<T>, maxHeldFrames> heldFrames;
+std::function<void(const heldFrame<T>&)> heldRelease;
 
-               std::uint8_t  lowerThreshold;
-               std::uint8_t  upperThreshold;
-//             std::uint8_t  volume; 
-   std::atomic<std::uint8_t> usage;
+    // Producer and consumer indices live on their own cache lines, each side caches the opposite index
+    // and only reloads it when the cached value does not leave enough room.
+    struct alignas(cacheLineSize) producerState
+    {
+std::atomic<std::uint64_t> tail         = 0;
+              std::uint64_t  cachedHead   = 0;
+std::atomic<std::uint32_t> spaceWaiters = 0;
+std::atomic<std::uint64_t> droppedFrames = 0;
+std::atomic<std::uint64_t> gapFrames     = 0;
+std::atomic<std::uint64_t> lateFrames    = 0;
+std::atomic<std::uint64_t> resyncs       = 0;
+std::unique_ptr<ringStorage> storage;
+std::unique_ptr<ringStorage> retired;
+              std::uint64_t  heldTail       = 0;
+              std::uint64_t  heldReleased   = 0;
+    }                        producer;
+    struct alignas(cacheLineSize) consumerState
+    {
+std::atomic<std::uint64_t> head           = 0;
+              std::uint64_t  cachedTail     = 0;
+              std::uint64_t  acquiredHead   = 0;
+std::atomic<std::uint64_t> underrunEvents = 0;
+std::atomic<std::uint64_t> underrunFrames = 0;
+std::atomic<std::uint64_t> primingFrames  = 0;
+std::atomic<std::uint32_t> dataWaiters    = 0;
+std::array<T, maxHoldChannels> lastFrame  = {};
+const ringStorage*           storage        = nullptr;
+                std::size_t  channels       = 1;
+                       bool  playing        = false;
+                       bool  priming        = false;
+std::atomic<std::uint64_t> heldHead       = 0;
+                std::size_t  heldOffset     = 0;
+                      float  gain           = 1.0f;
+                      float  rampTarget     = 1.0f;
+                      float  rampStep       = 0.0f;
+                std::size_t  rampLeft       = 0;
+    }                mutable consumer;
+    // Storage handshake of setCapacity, the consumer adopts the published storage at a block boundary
+    // and acknowledges it so that the producer can free the previous one. channels is the output channel
+    // count set by changeFormat, the consumer adopts it before it sizes a block. sampleRate is the output rate,
+    // published for the threads reporting the latency.
+    struct alignas(cacheLineSize) resizeState
+    {
+std::atomic<ringStorage*>       published    = nullptr;
+std::atomic<const ringStorage*> acknowledged = nullptr;
+   std::atomic<std::size_t>  channels     = 1;
+   std::atomic<std::size_t>  sampleRate   = 0;
+    }                mutable resize;
 
     public : //Public member functions
-                             audioQueue         () = default;
+                             audioQueue         () : audioQueue(0) {}
                              audioQueue         (const  std:: size_t    initialCapacity);
 
                        void  push               (                 T*  &&ptr, 
                                                  const  std:: size_t    frames,
-                                                 const  std:: size_t    outputChannelNum,
-                                                 const  std:: size_t    outputSampleRate);      
+                                                 const  std:: size_t    targetChannelNum,
+                                                 const  std:: size_t    targetSampleRate,
+                                                 const    mediaTicks    timestamp = untimed);      
                        void  pop                (                 T*   &ptr, 
-                                                 const  std:: size_t    frames,
-                                                 const          bool    mode);                
+                                                 const  std:: size_t    frames);
+                std::size_t  write              (      std::span<const T>   data);
+                std::size_t  writePlanar        (const                T*    data,
+                                                 const  std:: size_t    channelStride,
+                                                 const  std:: size_t    frames);
+                       bool  hold               (const    heldFrame<T>& frame);
+                std::size_t  read               (      std::span<T>         data);
+                std::size_t  readPlanar         (      std::span<T* const>  channels,
+                                                 const  std:: size_t    frames);
+              ringRegion<T>  prepare            (const  std:: size_t    frames);
+                       void  commit             (const  std:: size_t    frames);
+        ringRegion<const T>  peek               (const  std:: size_t    frames) const;
+                       bool  consume            (const  std:: size_t    frames);
+                       void  conceal            (      std::span<T>         missing);
+                       bool  waitForSpace       (const  std:: size_t    frames);
+                std::size_t  makeRoom           (const  std:: size_t    frames);
+                       void  reportDropped      (const  std:: size_t    frames);
+                       void  reserveScratch     (const  std:: size_t    frames);
+                       bool  waitForData        (const  std:: size_t    frames);
+                       void  clear              ();
 
     inline             void  setSampleRate      (const  std:: size_t    sRate){ audioSampleRate = sRate; }
     inline             void  setChannelNum      (const  std:: size_t    cNum ){ channelNum = cNum; }
+    inline             bool  setOutputChannelNum(const  std:: size_t    cNum ){ return changeFormat(cNum, outputSampleRate); }
+    inline             bool  setOutputSampleRate(const  std:: size_t    sRate){ return changeFormat(outputChannelNum, sRate); }
+                       void  setLatency         (const latencySettings& settings);
+                       bool  setChannelMatrix   (      std::span<const float> gains);
                        void  setCapacity        (const  std:: size_t    newCapacity);
-//                     void  setVolume          (const  std::uint8_t    volume);
-                       void  setDelay           (const  std::uint8_t    lower,
-                                                 const  std::uint8_t    upper,
-                                                 const  std:: size_t    iDelay,
-                                                 const  std:: size_t    oDelay);
+                       bool  setLayout          (const    sampleLayout  newLayout);
+    inline             void  setResampleQuality (const resampleQuality  quality){ resampler.setQuality(quality); }
+                       void  setDriftCompensation(const         bool    enable,
+                                                 const        double    maxPpm = 1000.0);
+                       void  setJitterBuffer    (const          bool    enable);
+                       void  setAdaptiveLatency (const          bool    enable,
+                                                 const std::chrono::milliseconds minimum,
+                                                 const std::chrono::milliseconds maximum);
+    inline             void  setGain            (const          float   gain){ gainTarget.store(gain, std::memory_order_relaxed); }
+    inline             void  setVolume          (const  std::uint8_t    volume){ setGain(static_cast<float>(volume) / 100.0f); }
+    inline             void  setWaitMode        (const        waitMode  mode,
+                                                 const std::chrono::microseconds limit) requires std::same_as<waitPolicy, runtimeWait> { blocking = mode; timeout = limit; }
+    inline             void  setWaitTimeout     (const std::chrono::microseconds limit){ timeout = limit; }
+    inline             void  setOverflowPolicy  (const  overflowPolicy  policy,
+                                                 const  std:: size_t    growLimit = 0) requires std::same_as<overflowHandling, runtimeOverflow>
+                                                 { overflow.store(policy, std::memory_order_relaxed); maxCapacity = growLimit; }
+    inline             void  setGrowLimit       (const  std:: size_t    growLimit){ maxCapacity = growLimit; }
+    inline             void  setUnderrunPolicy  (const underrunPolicy   policy){ underrun.store(policy, std::memory_order_relaxed); }
+    inline             void  setHeldRelease     (std::function<void(const heldFrame<T>&)> release){ heldRelease = std::move(release); }
                
     inline      std::size_t  channels           () const { return channelNum; }
+    inline      std::size_t  outputChannels     () const { adoptFormat(); return consumer.channels; }
     inline      std::size_t  sampleRate         () const { return audioSampleRate; }
-    inline      std::size_t  size               () const { return elementCount.load(); }
+    inline      std::size_t  outputRate         () const { return resize.sampleRate.load(std::memory_order_acquire); }
+    inline      std::size_t  targetSize         () const { return targetFill.load(std::memory_order_relaxed); }
+    inline      std::size_t  sizeLimit          () const { return fillLimit; }
+    inline      std::size_t  capacity           () const { return resize.published.load(std::memory_order_acquire)->size(); }
+    inline     sampleLayout  storageLayout      () const { return layout; }
+    inline  resampleQuality  resampleMode       () const { return resampler.currentQuality(); }
+    inline             bool  driftCompensated   () const { return driftEnabled; }
+    inline           double  driftPpm           () const { return driftEstimate.load(std::memory_order_relaxed); }
+    inline             bool  jitterBuffered     () const { return jitterEnabled.load(std::memory_order_relaxed); }
+                jitterStats  jitter             () const;
+    inline           double  arrivalJitter      () const { return tuner.jitter.load(std::memory_order_relaxed); }
+                     double  targetLatency      () const;
+                std::size_t  size               () const;
+              underrunStats  underruns          () const;
+    inline    std::uint64_t  dropped            () const { return producer.droppedFrames.load(std::memory_order_relaxed); }
+    inline            float  gain               () const { return gainTarget.load(std::memory_order_relaxed); }
+    inline             bool  gainSettled        () const { return !consumer.rampLeft && consumer.rampTarget == gain(); }
+    inline            float  currentGain        () const { return consumer.gain; }
                
     private : //Private member functions
-                       bool  enqueue            (const             T    value);
-                       bool  dequeue            (                  T   &value,
-                                                 const          bool    mode);
-                       void  clear              ();
-                       void  usageRefresh       (); 
-                       void  resample           (      std::vector<T>  &data,
-                                                 const std::  size_t    frames,
+                       void  reclaim            ();
+                       bool  changeFormat       (const  std:: size_t    channels,
+                                                 const  std:: size_t    sampleRate);
+    inline             void  adoptFormat        () const { consumer.channels = resize.channels.load(std::memory_order_acquire); }
+    inline   overflowPolicy  overflowMode       () const;
+    inline             bool  mirroring          () const { return producer.retired && !producer.retired->empty(); }
+    inline      std::size_t  usableSize         (const  std:: size_t    storageSize) const { return layout == sampleLayout::planar ? storageSize / outputChannelNum * outputChannelNum : storageSize; }
+                       bool  fitsLayout         (const  std:: size_t    storageSize) const;
+    inline      std::size_t  writableCapacity   () const { return std::min(fillLimit, usableSize(mirroring() ? std::min(producer.storage->size(), producer.retired->size()) : producer.storage->size())); }
+                std::size_t  storageSizeFor     (const  std:: size_t    requested) const;
+                std::size_t  slotOf             (const std::uint64_t    index,
+                                                 const  std:: size_t    storageSize,
+                                                 const  std:: size_t    channels) const;
+                std::size_t  reserve            (const  std:: size_t    frames);
+                std::size_t  acquire            (const  std:: size_t    frames) const;
+        ringRegion<const T>  acquireRegion      (const  std:: size_t    frames) const;
+                std::size_t  readHeld           (                 T*    out,
+                                                                  T* const* planes,
+                                                 const  std:: size_t    frames);
+                std::size_t  readSamples        (      std::span<T>         data);
+                std::size_t  readPlanarSamples  (      std::span<T* const>  channels,
+                                                 const  std:: size_t    frames);
+                       void  applyGain          (                 T*    out,
+                                                                  T* const* planes,
+                                                 const  std:: size_t    frames) const;
+    static             void  interleaveSamples  (const T* const*        planes,
+                                                 const  std:: size_t    channels,
+                                                 const  std:: size_t    first,
+                                                 const  std:: size_t    samples,
+                                                                  T*    out);
+    static             void  deinterleaveSamples(const                T*    in,
+                                                 const  std:: size_t    channels,
+                                                 const  std:: size_t    first,
+                                                 const  std:: size_t    samples,
+                                                                  T* const* planes);
+    inline      std::size_t  freeSpace          (const std::uint64_t head) const;
+                       void  applyLatency       ();
+                       void  updateDrift        (const  std:: size_t    frames);
+                       void  tuneLatency        (const  std:: size_t    frames);
+    inline      std::size_t  samplesFor         (const        double    milliseconds) const { return static_cast<std::size_t>(std::ceil(milliseconds * static_cast<double>(outputSampleRate) / 1000.0)) * outputChannelNum; }
+                std::size_t  alignTimeline      (const    mediaTicks    timestamp,
+                                                 const  std:: size_t    frames);
+                       void  insertSilence      (const  std:: size_t    frames);
+    template<typename ready>
+                       bool  waitUntil          (      std::atomic<std::uint64_t>& index,
+                                                       std::atomic<std::uint32_t>& waiters,
+                                                       ready    isReady);
+         std::span<const T>  resample           (      std::span<const T>   data,
+                                                 const std::  size_t    channels,
                                                  const std::  size_t    targetSampleRate);
-                       void channelConversion  (       std::vector<T>  &data,
+         std::span<const T>  channelConversion  (      std::span<const T>   data,
                                                  const std::  size_t    targetChannelNum);
 };
 
-#pragma region Constructors
+/**
+ * @brief Compile-time specializations for the two deployments.
+ *
+ * The realtime monitor never waits and keeps the newest audio, with a masked index on a cache-aligned ring.
+ * The recording path never loses a frame : the producer sleeps until there is room, on a huge-page ring.
+ */
+template<audioType T>
+using monitorQueue   = audioQueue<T, powerOfTwoIndex, alignedStorage,  noWait,    fixedOverflow<overflowPolicy::dropOldest>>;
 template<audioType T>
-inline audioQueue<T>::audioQueue(const std::size_t initialCapacity)
-    :   queue(initialCapacity+1), head(0), tail(0),usage(0), audioSampleRate(44100), channelNum(1), 
-    elementCount(0), lowerThreshold(0), upperThreshold(100), inputDelay(45), outputDelay(15) {}
+using recordingQueue = audioQueue<T, moduloIndex,     hugePageStorage, futexWait, fixedOverflow<overflowPolicy::block>>;
+
+#pragma region Constructors
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::audioQueue(const std::size_t initialCapacity)
+    :   audioSampleRate(44100), channelNum(1), outputChannelNum(1), outputSampleRate(44100), latency{}, 
+    targetFill(0), fillLimit(SIZE_MAX), latencyCapacity(0), grownCapacity(0), pendingCapacity(0), layout(sampleLayout::interleaved), 
+    blocking(waitMode::deadline), timeout(std::chrono::milliseconds(45)), overflow(overflowPolicy::block), maxCapacity(0), 
+    underrun(underrunPolicy::silence), gainTarget(1.0f), driftEnabled(false), driftMaxPpm(0.0), driftFill(0.0), driftIntegral(0.0), driftEstimate(0.0), 
+    jitterEnabled(false), nextTimestamp(untimed) 
+{
+    producer.storage = std::make_unique<ringStorage>(indexPolicy::capacityFor(initialCapacity));
+    consumer.storage = producer.storage.get();
+    resize.published   .store(producer.storage.get());
+    resize.acknowledged.store(producer.storage.get());
+    resize.sampleRate  .store(outputSampleRate);
+}
 #pragma endregion
 
 #pragma region Private member functions
-template<audioType T>
-bool audioQueue<T>::enqueue(const T value)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::reclaim()
 {
-    std::size_t currentTail = tail.load(std::memory_order_relaxed);
-    std::size_t    nextTail = (currentTail + 1) % queue.size();
+    // The previous storage is freed on the producer thread once the consumer has switched away from it,
+    // held buffers go back to their owner once the consumer has read them.
+    if (producer.retired && resize.acknowledged.load(std::memory_order_acquire) == producer.storage.get()) producer.retired.reset();
+
+    const auto consumed = consumer.heldHead.load(std::memory_order_acquire);
+    for (; producer.heldReleased < consumed; producer.heldReleased++)
+        if (heldRelease) heldRelease(heldFrames[producer.heldReleased % maxHeldFrames]);
+}
 
-    if (nextTail == head.load(std::memory_order_acquire)) return false; // Queue is full
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::changeFormat(const std::size_t channels, const std::size_t sampleRate)
+{
+    // Producer thread only. Buffered frames were written with the current channel count, a new one is only taken
+    // by an empty queue. The consumer adopts it before sizing its next block, and it cannot see a frame written
+    // after the change without seeing the change.
+    if (channels == outputChannelNum && sampleRate == outputSampleRate) return true;
+    if (channels != outputChannelNum && size()) return false;
+    outputChannelNum = channels;
+    outputSampleRate = sampleRate;
+    grownCapacity    = 0;
+    applyLatency();
+    resize.sampleRate.store(sampleRate, std::memory_order_release);
 
-    queue[currentTail] = value;
-    tail.store(nextTail, std::memory_order_release);
-    elementCount.fetch_add(1, std::memory_order_relaxed);
+    // The storage is reshaped for the new channel count with or without latency settings, and the count is only
+    // published with a storage of that shape. A deferred reshape publishes it from setCapacity.
+    if (!pendingCapacity) setCapacity(producer.storage->size());
+    if (fitsLayout(producer.storage->size())) resize.channels.store(channels, std::memory_order_release);
 
     return true;
 }
 
-template<audioType T>
-bool audioQueue<T>::dequeue(T& value, const bool mode)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::storageSizeFor(const std::size_t requested) const
 {
-    std::size_t currentHead = head.load(std::memory_order_relaxed);
+    // Planar storage holds whole planes, the index policy applies to the frames of each plane.
+    if (layout != sampleLayout::planar) return indexPolicy::capacityFor(requested);
+    return indexPolicy::capacityFor((requested + outputChannelNum - 1) / outputChannelNum) * outputChannelNum;
+}
 
-    if (currentHead == tail.load(std::memory_order_acquire)) return false; // Queue is empty
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::fitsLayout(const std::size_t storageSize) const
+{
+    // Whether the index policy maps the ring, or each plane of it, onto distinct slots with the current shape.
+    const auto slots = layout == sampleLayout::planar ? storageSize / outputChannelNum : storageSize;
+    return !slots || indexPolicy::capacityFor(slots) == slots;
+}
 
-    if (!mode) value = queue[currentHead];
-    else value += queue[currentHead];
-    head.store((currentHead + 1) % queue.size(), std::memory_order_release);
-    elementCount.fetch_sub(1, std::memory_order_relaxed);
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::slotOf(const std::uint64_t index, const std::size_t storageSize, const std::size_t channels) const
+{
+    // Slot of a single sample, used by the per-sample paths (resize migration, mirroring, hold-last).
+    if (layout != sampleLayout::planar) return indexPolicy::slot(index, storageSize);
 
-    return true;
+    const auto planeSize = storageSize / channels;
+    return static_cast<std::size_t>(index % channels) * planeSize + indexPolicy::slot(index / channels, planeSize);
 }
 
-template<audioType T>
-inline void audioQueue<T>::clear()
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::interleaveSamples(const T* const* planes, const std::size_t channels, const std::size_t first, const std::size_t samples, T* out)
 {
-    head        .store(0);
-    tail        .store(0);
-    elementCount.store(0);
+    // out[k] is sample first + k of the interleaved view of planes.
+    auto        frame   = first / channels;
+    auto        channel = first % channels;
+    std::size_t k       = 0;
+    if constexpr (std::same_as<T, float>)
+    {
+        if (channels == 2 && channel == 0)
+        {
+            audioKernels::interleaveStereo(planes[0] + frame, planes[1] + frame, out, samples / 2);
+            k      = samples / 2 * 2;
+            frame += samples / 2;
+        }
+    }
+    for (; k < samples; k++)
+    {
+        out[k] = planes[channel][frame];
+        if (++channel == channels) { channel = 0; frame++; }
+    }
 }
 
-template<audioType T>
-inline void audioQueue<T>::usageRefresh(){ usage.store(static_cast<std::uint8_t>(static_cast<double>(elementCount.load()) / queue.size() * 100.0)); }
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::deinterleaveSamples(const T* in, const std::size_t channels, const std::size_t first, const std::size_t samples, T* const* planes)
+{
+    // in[k] goes to sample first + k of the interleaved view of planes.
+    auto        frame   = first / channels;
+    auto        channel = first % channels;
+    std::size_t k       = 0;
+    if constexpr (std::same_as<T, float>)
+    {
+        if (channels == 2 && channel == 0)
+        {
+            audioKernels::deinterleaveStereo(in, planes[0] + frame, planes[1] + frame, samples / 2);
+            k      = samples / 2 * 2;
+            frame += samples / 2;
+        }
+    }
+    for (; k < samples; k++)
+    {
+        planes[channel][frame] = in[k];
+        if (++channel == channels) { channel = 0; frame++; }
+    }
+}
 
-template<audioType T>
-void audioQueue<T>::resample(std::vector<T>& data, const std::size_t frames, const std::size_t targetSampleRate)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::freeSpace(const std::uint64_t head) const
+{
+    // Clamped, the fill level may be above the limit right after the latency was lowered.
+    const auto used  = static_cast<std::size_t>(producer.tail.load(std::memory_order_relaxed) - head);
+    const auto limit = writableCapacity();
+    return limit > used ? limit - used : 0;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::applyLatency()
 {
-    const auto resampleRatio = static_cast<double>(targetSampleRate) / static_cast<double>(audioSampleRate);
-    const auto newSize       = static_cast<size_t>(static_cast<double>(frames) * static_cast<double>(channelNum) * resampleRatio);//previous frames number * channel number * ratio
-    std::vector<T> temp(newSize);
+    if (latency.maximum.count() <= 0) return;
 
-    SRC_STATE* srcState = src_new(SRC_SINC_BEST_QUALITY, channelNum, nullptr);
+    // A storage enlarged by the grow policy is kept, with the fill limit raised to leave the headroom under it.
+    const auto headroom = samplesFor(static_cast<double>(latency.headroom.count()));
+    targetFill.store(samplesFor(tuner.enabled ? tuner.target : static_cast<double>(latency.target.count())), std::memory_order_relaxed);
+    fillLimit       = std::max(samplesFor(static_cast<double>(latency.maximum .count())), usableSize(grownCapacity) > headroom ? usableSize(grownCapacity) - headroom : 0);
+    latencyCapacity = std::max(storageSizeFor(fillLimit + headroom), grownCapacity);
+    setCapacity(latencyCapacity);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::updateDrift(const std::size_t frames)
+{
+    // PI controller on the smoothed fill level. One ppm of correction moves the fill by 1 us per second, so the
+    // loop is s^2 + 0.001 Kp s + 0.001 Ki = s^2 + 0.2 s + 0.01 : a double pole at -0.1 /s, critically damped and
+    // settling within 2 % in about a minute, far below audible pitch changes. The 1 s smoothing is ten times faster.
+    constexpr double proportionalGain = 200.0;  // ppm per ms of fill error
+    constexpr double integralGain     = 10.0;   // ppm per ms of fill error and per second
+    constexpr double smoothingTime    = 1.0;    // seconds
 
-    SRC_DATA srcData;
-    srcData.end_of_input    = true;
-    srcData.data_in         = data.data();
-    srcData.data_out        = temp.data();
-    srcData.input_frames    = frames;
-    srcData.output_frames   = static_cast<int>(frames * resampleRatio);
-    srcData.src_ratio       = resampleRatio;
+    const auto target = targetFill.load(std::memory_order_relaxed);
+    if (!driftEnabled || !target || !outputSampleRate || !audioSampleRate) return;
 
-    src_process(srcState, &srcData);
-    src_delete(srcState);
+    const auto toMs    = [this](const std::size_t samples) { return static_cast<double>(samples / outputChannelNum) * 1000.0 / static_cast<double>(outputSampleRate); };
+    const auto elapsed = static_cast<double>(frames) / static_cast<double>(audioSampleRate);
+    driftFill += std::min(1.0, elapsed / smoothingTime) * (toMs(size()) - driftFill);
 
-    data = std::move(temp);
-    audioSampleRate = targetSampleRate;
+    // A fill above the target means the sender clock runs fast, the output ratio is lowered by as many ppm.
+    const auto error = driftFill - toMs(target);
+    driftIntegral    = std::clamp(driftIntegral + integralGain * error * elapsed, -driftMaxPpm, driftMaxPpm);
+    const auto ppm   = std::clamp(proportionalGain * error + driftIntegral, -driftMaxPpm, driftMaxPpm);
+
+    driftEstimate.store(driftIntegral, std::memory_order_relaxed);
+    resampler.setCorrection(1.0 - ppm * 1e-6);
 }
 
-template<audioType T>
-void audioQueue<T>::channelConversion(std::vector<T>& data, const std::size_t targetChannelNum)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::tuneLatency(const std::size_t frames)
 {
-    const auto newSize = data.size() / channelNum * targetChannelNum;
-    data.reserve(newSize);
+    // The target grows fast after an underrun and shrinks slowly while the stream is stable, never below
+    // a margin over the inter-arrival jitter. Overruns mean the target leaves too little room under the maximum.
+    constexpr double jitterGain   = 1.0 / 16.0;     // RFC 3550 jitter smoothing
+    constexpr double jitterMargin = 3.0;            // floor of the target in multiples of the jitter
+    constexpr double growFactor   = 1.5;
+    constexpr double shrinkStep   = 1.0;            // ms
+    constexpr double stablePeriod = 10.0;           // seconds without glitch before each shrink step
 
-    //channel conversion
-    for (auto i = 0; i < newSize; i += channelNum)
+    if (!tuner.enabled || !audioSampleRate) return;
+
+    // Inter-arrival jitter : deviation of the spacing between pushes from the duration of the previous block.
+    const auto now       = std::chrono::steady_clock::now();
+    const auto blockTime = static_cast<double>(frames) * 1000.0 / static_cast<double>(audioSampleRate);
+    auto       jitter    = tuner.jitter.load(std::memory_order_relaxed);
+    if (tuner.lastArrival != std::chrono::steady_clock::time_point{})
     {
-        for (auto j = 0; j < (targetChannelNum - channelNum); j++)
-        {
+        const auto spacing = std::chrono::duration<double, std::milli>(now - tuner.lastArrival).count();
+        jitter += (std::abs(spacing - tuner.lastBlock) - jitter) * jitterGain;
+        tuner.jitter.store(jitter, std::memory_order_relaxed);
+    }
+    tuner.lastArrival = now;
+    tuner.lastBlock   = blockTime;
+
+    const auto underruns = consumer.underrunEvents.load(std::memory_order_relaxed);
+    const auto drops     = producer.droppedFrames .load(std::memory_order_relaxed);
+    const auto floor     = std::max(tuner.minimum, jitterMargin * jitter);
+
+    auto target = tuner.target;
+    if (underruns != tuner.seenUnderruns)
+    {
+        target           = std::max(target * growFactor, floor);
+        tuner.stableTime = 0.0;
+    }
+    else if (drops != tuner.seenDrops)
+    {
+        target           = target / growFactor;
+        tuner.stableTime = 0.0;
+    }
+    else if ((tuner.stableTime += blockTime / 1000.0) >= stablePeriod)
+    {
+        target          -= shrinkStep;
+        tuner.stableTime = 0.0;
+    }
+    target              = std::min(std::max(target, floor), tuner.maximum);
+    tuner.seenUnderruns = underruns;
+    tuner.seenDrops     = drops;
 
+    if (target != tuner.target)
+    {
+        tuner.target = target;
+        targetFill.store(samplesFor(target), std::memory_order_relaxed);
+    }
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::alignTimeline(const mediaTicks timestamp, const std::size_t frames)
+{
+    // Keeps the ring on the sender timeline : gaps are filled before the block, the part of the block
+    // older than what was already queued is dropped. Returns the number of leading input frames to drop.
+    if (!jitterEnabled.load(std::memory_order_relaxed) || timestamp == untimed || !audioSampleRate || !outputSampleRate) return 0;
+
+    const auto blockEnd = timestamp + mediaTicks(static_cast<std::int64_t>(frames) * mediaTicks::period::den / static_cast<std::int64_t>(audioSampleRate));
+    const auto expected = nextTimestamp;
+    if (expected == untimed)
+    {
+        nextTimestamp = blockEnd;
+        return 0;
+    }
+
+    // Offsets within a millisecond are timecode rounding, beyond the queue size the sender was restarted.
+    const auto offset    = std::llround(static_cast<double>((timestamp - expected).count()) * static_cast<double>(audioSampleRate) / mediaTicks::period::den);
+    const auto tolerance = static_cast<long long>(std::max<std::size_t>(audioSampleRate / 1000, 1));
+    const auto limit     = static_cast<long long>(writableCapacity() / outputChannelNum * audioSampleRate / outputSampleRate);
+    if (std::abs(offset) > limit)
+    {
+        producer.resyncs.store(producer.resyncs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        nextTimestamp = blockEnd;
+        return 0;
+    }
+    nextTimestamp = std::max(expected, blockEnd);
+
+    if (offset > tolerance)
+    {
+        const auto missing = static_cast<std::size_t>(offset) * outputSampleRate / audioSampleRate;
+        producer.gapFrames.store(producer.gapFrames.load(std::memory_order_relaxed) + missing, std::memory_order_relaxed);
+        insertSilence(missing);
+    }
+    else if (offset < -tolerance)
+    {
+        const auto late = std::min(static_cast<std::size_t>(-offset), frames);
+        producer.lateFrames.store(producer.lateFrames.load(std::memory_order_relaxed) + late, std::memory_order_relaxed);
+        return late;
+    }
+    return 0;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::insertSilence(const std::size_t frames)
+{
+    std::size_t inserted = 0;
+    while (inserted < frames)
+    {
+        const auto count = reserve(makeRoom(frames - inserted));
+        if (!count) break;
+
+        // Silence is zero in both layouts, only the slots differ.
+        auto&      storage = *producer.storage;
+        const auto tail    = producer.tail.load(std::memory_order_relaxed);
+        for (auto index = tail; index < tail + count * outputChannelNum; index++) storage[slotOf(index, storage.size(), outputChannelNum)] = T{};
+        commit(count);
+        inserted += count;
+    }
+    if (inserted < frames) reportDropped(frames - inserted);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline overflowPolicy audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::overflowMode() const
+{
+    if constexpr (std::same_as<overflowHandling, runtimeOverflow>) return overflow.load(std::memory_order_relaxed);
+    else                                                           return overflowHandling::value;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+template<typename ready>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::waitUntil(std::atomic<std::uint64_t>& index, std::atomic<std::uint32_t>& waiters, ready isReady)
+{
+    auto current = index.load(std::memory_order_acquire);
+    if (isReady(current)) return true;
+
+    if constexpr (std::same_as<waitPolicy, noWait>) return false;
+    else if constexpr (std::same_as<waitPolicy, futexWait>)
+    {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        while (!isReady(current = index.load(std::memory_order_seq_cst))) index.wait(current, std::memory_order_acquire);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    else if constexpr (std::same_as<waitPolicy, spinWait>)
+    {
+        // Never sleeps, the clock is only read every few hundred polls.
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (std::size_t polls = 1; !isReady(index.load(std::memory_order_acquire)); polls++)
+            if (polls % 256 == 0 && std::chrono::steady_clock::now() >= deadline) return false;
+        return true;
+    }
+    else switch (blocking)
+    {
+        case waitMode::failFast : return false;
+        case waitMode::block    :
+            // Register before re-checking, the other side only notifies when it sees a waiter.
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            while (!isReady(current = index.load(std::memory_order_seq_cst))) index.wait(current, std::memory_order_acquire);
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        case waitMode::deadline :
+        {
+            // std::atomic::wait has no timeout, a bounded wait polls with an exponential backoff instead.
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            auto       backoff  = std::chrono::microseconds(50);
+            while (!isReady(index.load(std::memory_order_acquire)))
+            {
+                const auto now = std::chrono::steady_clock::now();
+                if (now >= deadline) return false;
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(backoff, deadline - now));
+                backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+            }
+            return true;
         }
     }
+    return false;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::span<const T> audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::resample(std::span<const T> data, const std::size_t channels, const std::size_t targetSampleRate)
+{
+    if constexpr (std::same_as<T, float>) return resampler.process(data, channels, audioSampleRate, targetSampleRate);
+    else
+    {
+        // The resampler works on float, other sample types are only converted around it.
+        if (floatBuffer.size() < data.size()) floatBuffer.resize(data.size());
+        audioKernels::convertSamples(data.data(), floatBuffer.data(), data.size());
+
+        const auto resampled = resampler.process({ floatBuffer.data(), data.size() }, channels, audioSampleRate, targetSampleRate);
+        if (resampleBuffer.size() < resampled.size()) resampleBuffer.resize(resampled.size());
+        audioKernels::convertSamples(resampled.data(), resampleBuffer.data(), resampled.size());
 
-    channelNum = targetChannelNum;
+        return { resampleBuffer.data(), resampled.size() };
+    }
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::span<const T> audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::channelConversion(std::span<const T> data, const std::size_t targetChannelNum)
+{
+    // The default layout is only applied when the shape changes, a custom matrix of the right shape is kept.
+    if (!matrix.matches(channelNum, targetChannelNum)) matrix.setLayout(channelNum, targetChannelNum);
+
+    const auto newSize = data.size() / channelNum * targetChannelNum;
+    if (conversionBuffer.size() < newSize) conversionBuffer.resize(newSize);
+
+    std::span<T> converted(conversionBuffer.data(), newSize);
+    matrix.process<T>(data, converted);
+
+    return converted;
 }
 
 #pragma endregion
 
 #pragma region Public APIs
-template<audioType T>
-void audioQueue<T>::push(T*&& ptr, std::size_t frames, const std::size_t outputChannelNum, const std::size_t outputSampleRate)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::size() const
+{
+    // The fill level is derived from the indices, no shared counter is written on the hot path.
+    // Head is loaded first so that the later tail can never be behind it.
+    const auto currentHead = consumer.head.load(std::memory_order_acquire);
+    return static_cast<std::size_t>(producer.tail.load(std::memory_order_acquire) - currentHead);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::reserve(const std::size_t frames)
+{
+    // Number of whole frames that can be written now. While a resize is not acknowledged the free space
+    // is bounded by the smaller of both storages. Nothing is written to the storage in the held layout.
+    if (pendingCapacity) setCapacity(pendingCapacity);
+    reclaim();
+    if (layout == sampleLayout::held) return 0;
+
+    // A storage still shaped for another channel count or layout waits for its resize, its slots would overlap.
+    if (!fitsLayout(producer.storage->size())) return 0;
+    if (freeSpace(producer.cachedHead) < frames * outputChannelNum) producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+    return std::min(frames, freeSpace(producer.cachedHead) / outputChannelNum);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+ringRegion<T> audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::prepare(const std::size_t frames)
+{
+    // Hand out up to frames whole frames of writable ring storage, nothing is published before commit.
+    // Interleaved layout only, planar storage is written through write and writePlanar.
+    if (layout != sampleLayout::interleaved) return {};
+
+    const auto count = reserve(frames) * outputChannelNum;
+    if (!count) return {};
+
+    auto&      storage     = *producer.storage;
+    const auto capacity    = storage.size();
+    const auto currentTail = producer.tail.load(std::memory_order_relaxed);
+
+    const auto start     = indexPolicy::slot(currentTail, capacity);
+    const auto firstPart = std::min(count, capacity - start);
+
+    return { { storage.data() + start, firstPart }, { storage.data(), count - firstPart } };
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::commit(const std::size_t frames)
+{
+    const auto count = frames * outputChannelNum;
+    if (!count) return;
+
+    const auto currentTail = producer.tail.load(std::memory_order_relaxed);
+    if (mirroring())
+    {
+        // The consumer may still read the previous storage, the committed samples are mirrored there until it switches.
+        // An empty previous storage cannot be read and is never mirrored.
+        const auto& storage = *producer.storage;
+              auto& retired = *producer.retired;
+        for (auto index = currentTail; index < currentTail + count; index++)
+            retired[slotOf(index, retired.size(), outputChannelNum)] = storage[slotOf(index, storage.size(), outputChannelNum)];
+    }
+    producer.tail.store(currentTail + count, std::memory_order_release);
+
+    // Uncontended path : a fence and a plain load, the syscall only happens when a consumer is blocked.
+    if constexpr (waitPolicy::notifies)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer.dataWaiters.load(std::memory_order_relaxed)) producer.tail.notify_one();
+    }
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::write(std::span<const T> data)
+{
+    // Reserve the whole free region once, copy in at most two segments (before and after the wrap),
+    // then publish the new tail with a single release store.
+    if (layout == sampleLayout::planar)
+    {
+        const auto frames = outputChannelNum <= maxPlanarChannels ? reserve(data.size() / outputChannelNum) : 0;
+        if (!frames) return 0;
+
+        auto&      storage   = *producer.storage;
+        const auto planeSize = storage.size() / outputChannelNum;
+        const auto start     = indexPolicy::slot(producer.tail.load(std::memory_order_relaxed) / outputChannelNum, planeSize);
+        const auto firstPart = std::min(frames, planeSize - start);
+
+        std::array<T*, maxPlanarChannels> planes;
+        for (std::size_t c = 0; c < outputChannelNum; c++) planes[c] = storage.data() + c * planeSize + start;
+        deinterleaveSamples(data.data(), outputChannelNum, 0, firstPart * outputChannelNum, planes.data());
+        for (std::size_t c = 0; c < outputChannelNum; c++) planes[c] = storage.data() + c * planeSize;
+        deinterleaveSamples(data.data() + firstPart * outputChannelNum, outputChannelNum, 0, (frames - firstPart) * outputChannelNum, planes.data());
+
+        commit(frames);
+        return frames;
+    }
+
+    const auto region = prepare(data.size() / outputChannelNum);
+    if (region.empty()) return 0;
+
+    std::copy_n(data.begin(),                       region.first .size(), region.first .begin());
+    std::copy_n(data.begin() + region.first.size(), region.second.size(), region.second.begin());
+
+    const auto frames = region.size() / outputChannelNum;
+    commit(frames);
+
+    return frames;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::writePlanar(const T* data, const std::size_t channelStride, const std::size_t frames)
+{
+    // Planar input, channel c starts at data + c * channelStride. Planar storage takes it with one copy per channel,
+    // interleaved storage interleaves it on the way in.
+    if (outputChannelNum > maxPlanarChannels) return 0;
+    const auto count = reserve(frames);
+    if (!count) return 0;
+
+    auto&      storage = *producer.storage;
+    const auto tail    = producer.tail.load(std::memory_order_relaxed);
+
+    std::array<const T*, maxPlanarChannels> source;
+    for (std::size_t c = 0; c < outputChannelNum; c++) source[c] = data + c * channelStride;
+
+    if (layout == sampleLayout::planar)
+    {
+        const auto planeSize = storage.size() / outputChannelNum;
+        const auto start     = indexPolicy::slot(tail / outputChannelNum, planeSize);
+        const auto firstPart = std::min(count, planeSize - start);
+        for (std::size_t c = 0; c < outputChannelNum; c++)
+        {
+            auto plane = storage.data() + c * planeSize;
+            std::copy_n(source[c],             firstPart,         plane + start);
+            std::copy_n(source[c] + firstPart, count - firstPart, plane);
+        }
+    }
+    else
+    {
+        const auto start     = indexPolicy::slot(tail, storage.size());
+        const auto firstPart = std::min(count * outputChannelNum, storage.size() - start);
+        interleaveSamples(source.data(), outputChannelNum, 0,         firstPart,                            storage.data() + start);
+        interleaveSamples(source.data(), outputChannelNum, firstPart, count * outputChannelNum - firstPart, storage.data());
+    }
+    commit(count);
+
+    return count;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::hold(const heldFrame<T>& frame)
+{
+    // Producer side, held layout only. The buffer must be in the output format, it is read in place
+    // and must stay valid until the release callback returns it. false leaves it with the caller :
+    // wrong format, no free descriptor or no room under the latency limit.
+    reclaim();
+    if (layout != sampleLayout::held || !frame.frames || frame.channels != outputChannelNum || frame.sampleRate != outputSampleRate) return false;
+    if (producer.heldTail - producer.heldReleased == maxHeldFrames || size() + frame.frames * outputChannelNum > fillLimit) return false;
+
+    // The descriptor is published by the release store of the tail in commit.
+    heldFrames[producer.heldTail % maxHeldFrames] = frame;
+    producer.heldTail++;
+    commit(frame.frames);
+
+    return true;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::acquire(const std::size_t frames) const
+{
+    // Block boundary : adopt the storage published by a resize before reading.
+    if (const auto latest = resize.published.load(std::memory_order_acquire); latest != consumer.storage)
+    {
+        consumer.storage = latest;
+        resize.acknowledged.store(latest, std::memory_order_release);
+    }
+
+    // The head is only read here : the block is read and consumed from this snapshot even if a dropOldest
+    // producer moves the head meanwhile.
+    const auto currentHead = consumer.head.load(std::memory_order_acquire);
+    const auto available   = [&] { return consumer.cachedTail > currentHead ? static_cast<std::size_t>(consumer.cachedTail - currentHead) : 0; };
+    consumer.acquiredHead  = currentHead;
+
+    // Jitter buffer : after a start or an underrun, playout resumes once the presentation delay is buffered
+    // and an incomplete block counts as an underrun.
+    const auto jitterMode = jitterEnabled.load(std::memory_order_relaxed);
+    consumer.priming      = false;
+    const auto wanted     = jitterMode && !consumer.playing ? std::max(targetFill.load(std::memory_order_relaxed), frames * consumer.channels) : frames * consumer.channels;
+
+    if (available() < wanted)
+    {
+        // Frames written after a channel count change are read from the next block, with the new count.
+        consumer.cachedTail = producer.tail.load(std::memory_order_acquire);
+        if (resize.channels.load(std::memory_order_relaxed) != consumer.channels) return 0;
+    }
+    if (jitterMode)
+    {
+        // The block that runs out is an underrun, the ones after it only wait for the delay to be buffered again.
+        consumer.priming = !consumer.playing;
+        consumer.playing = available() >= wanted;
+        if (!consumer.playing) return 0;
+    }
+    return std::min(frames, available() / consumer.channels);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::readHeld(T* out, T* const* planes, const std::size_t frames)
+{
+    // Read in place from the held buffers, into interleaved out or into planes. A buffer is handed back
+    // to the producer once its last frame has been read.
+    const auto count = consumer.channels <= maxPlanarChannels ? acquire(frames) : 0;
+    if (!count) return 0;
+
+    const auto holdLast = underrun.load(std::memory_order_relaxed) == underrunPolicy::holdLast;
+    auto       index    = consumer.heldHead.load(std::memory_order_relaxed);
+    std::size_t done    = 0;
+    while (done < count)
+    {
+        const auto& frame = heldFrames[index % maxHeldFrames];
+        const auto  part  = std::min(count - done, frame.frames - consumer.heldOffset);
+
+        std::array<const T*, maxPlanarChannels> source;
+        for (std::size_t c = 0; c < consumer.channels; c++) source[c] = frame.data + c * frame.channelStride + consumer.heldOffset;
+        if (out) interleaveSamples(source.data(), consumer.channels, 0, part * consumer.channels, out + done * consumer.channels);
+        else for (std::size_t c = 0; c < consumer.channels; c++) std::copy_n(source[c], part, planes[c] + done);
+        if (holdLast) for (std::size_t c = 0; c < consumer.channels; c++) consumer.lastFrame[c] = source[c][part - 1];
+
+        done                += part;
+        consumer.heldOffset += part;
+        if (consumer.heldOffset == frame.frames)
+        {
+            consumer.heldOffset = 0;
+            index++;
+        }
+    }
+    consumer.heldHead.store(index, std::memory_order_release);
+    consume(count);
+
+    return count;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::applyGain(T* out, T* const* planes, const std::size_t frames) const
+{
+    // Consumer side. A new target starts a linear ramp of gainRampFrames frames from the current gain,
+    // the block is left untouched at unity gain with no ramp pending.
+    if (!frames) return;
+    if (const auto target = gain(); target != consumer.rampTarget)
+    {
+        consumer.rampTarget = target;
+        consumer.rampLeft   = gainRampFrames;
+        consumer.rampStep   = (target - consumer.gain) / static_cast<float>(gainRampFrames);
+    }
+    if (!consumer.rampLeft && consumer.gain == 1.0f) return;
+
+    const auto ramped = std::min(frames, consumer.rampLeft);
+    const auto apply  = [&](T* data, const std::size_t stride)
+    {
+        audioKernels::gainRamp (data, ramped, stride, consumer.gain, consumer.rampStep);
+        audioKernels::applyGain(data + ramped * stride, (frames - ramped) * stride, ramped == consumer.rampLeft ? consumer.rampTarget : consumer.gain);
+    };
+    if (out) apply(out, consumer.channels);
+    else for (std::size_t c = 0; c < consumer.channels; c++) apply(planes[c], 1);
+
+    consumer.rampLeft -= ramped;
+    consumer.gain      = consumer.rampLeft ? consumer.gain + consumer.rampStep * static_cast<float>(ramped) : consumer.rampTarget;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+ringRegion<const T> audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::peek(const std::size_t frames) const
+{
+    // Readable view of up to frames whole frames, the data stays in the queue until consume.
+    // Interleaved layout only, planar storage and held buffers are read through read and readPlanar.
+    // Never under dropOldest : the producer may reclaim the frames of a view still in use, such a queue is read
+    // through read and readPlanar, which redo a copy the producer overwrote.
+    if (layout != sampleLayout::interleaved || overflowMode() == overflowPolicy::dropOldest) return {};
+    adoptFormat();
+    return acquireRegion(frames);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+ringRegion<const T> audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::acquireRegion(const std::size_t frames) const
+{
+    const auto count = acquire(frames) * consumer.channels;
+    if (!count) return {};
+
+    const auto& storage     = *consumer.storage;
+    const auto  capacity    = storage.size();
+    const auto  start       = indexPolicy::slot(consumer.acquiredHead, capacity);
+    const auto firstPart = std::min(count, capacity - start);
+
+    return { { storage.data() + start, firstPart }, { storage.data(), count - firstPart } };
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::consume(const std::size_t frames)
+{
+    // false when the producer reclaimed the frames under dropOldest while they were being read.
+    const auto count = frames * consumer.channels;
+    if (!count) return true;
+
+    const auto currentHead = consumer.acquiredHead;
+    if (underrun.load(std::memory_order_relaxed) == underrunPolicy::holdLast && consumer.channels <= maxHoldChannels && layout != sampleLayout::held)
+    {
+        // Keep the last frame for concealment, it is read before head is published so the producer cannot overwrite it.
+        const auto lastFrame = currentHead + count - consumer.channels;
+        for (std::size_t c = 0; c < consumer.channels; c++) consumer.lastFrame[c] = (*consumer.storage)[slotOf(lastFrame + c, consumer.storage->size(), consumer.channels)];
+    }
+    if (overflowMode() == overflowPolicy::dropOldest)
+    {
+        // A failed exchange means the producer advanced the head over the frames being read and counted them
+        // as dropped, the head it left points at unread frames and stays. What was read may be overwritten.
+        auto expected = currentHead;
+        if (!consumer.head.compare_exchange_strong(expected, currentHead + count, std::memory_order_release, std::memory_order_relaxed)) return false;
+    }
+    else consumer.head.store(currentHead + count, std::memory_order_release);
+
+    if constexpr (waitPolicy::notifies)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer.spaceWaiters.load(std::memory_order_relaxed)) consumer.head.notify_one();
+    }
+    return true;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::conceal(std::span<T> missing)
+{
+    // Wait-free : no sleep, no print, no allocation, only the counters are updated.
+    adoptFormat();
+    const auto frames = missing.size() / consumer.channels;
+    if (!frames) return;
+
+    if (consumer.priming) consumer.primingFrames.store(consumer.primingFrames.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+    else
+    {
+        consumer.underrunEvents.store(consumer.underrunEvents.load(std::memory_order_relaxed) + 1,      std::memory_order_relaxed);
+        consumer.underrunFrames.store(consumer.underrunFrames.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+    }
+
+    if (underrun.load(std::memory_order_relaxed) == underrunPolicy::holdLast && consumer.channels <= maxHoldChannels)
+    {
+        // The held frame was stored before gain, it follows the gain like the frames read before it.
+        for (std::size_t f = 0; f < frames; f++)
+            std::copy_n(consumer.lastFrame.begin(), consumer.channels, missing.begin() + f * consumer.channels);
+        applyGain(missing.data(), nullptr, frames);
+    }
+    else std::fill(missing.begin(), missing.end(), T{});
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::waitForSpace(const std::size_t frames)
+{
+    // Producer side, a request larger than the queue waits for the queue to be empty.
+    const auto capacity    = std::min(usableSize(producer.storage->size()), fillLimit);
+    const auto needed      = std::min(frames * outputChannelNum, capacity / outputChannelNum * outputChannelNum);
+    if (!needed) return frames == 0;
+
+    return waitUntil(consumer.head, producer.spaceWaiters, [&](const std::uint64_t head) 
+    {
+        reclaim();
+        return freeSpace(head) >= needed; 
+    });
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::makeRoom(const std::size_t frames)
+{
+    // Producer side, returns how many of frames can be written once the overflow policy is applied.
+    // A resize deferred by setCapacity is retried here until it is in place.
+    if (pendingCapacity) setCapacity(pendingCapacity);
+    reclaim();
+    const auto currentTail = producer.tail.load(std::memory_order_relaxed);
+    const auto freeFrames  = [&] { return freeSpace(producer.cachedHead) / outputChannelNum; };
+
+    if (freeFrames() >= frames) return frames;
+    producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+    if (freeFrames() >= frames) return frames;
+
+    switch (overflowMode())
+    {
+        case overflowPolicy::dropNewest : break;
+        case overflowPolicy::block      :
+            waitForSpace(frames);
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+            break;
+        case overflowPolicy::dropOldest :
+        {
+            // Advance the head by whole frames, the consumer may be moving it at the same time.
+            const auto capacity = writableCapacity();
+            const auto needed   = std::min(frames, capacity / outputChannelNum) * outputChannelNum;
+            const auto minHead  = currentTail + needed - capacity;
+            auto       current = producer.cachedHead;
+            while (current < minHead)
+            {
+                const auto overwritten = (static_cast<std::size_t>(minHead - current) + outputChannelNum - 1) / outputChannelNum;
+                if (consumer.head.compare_exchange_weak(current, current + overwritten * outputChannelNum, std::memory_order_acq_rel, std::memory_order_acquire))
+                {
+                    reportDropped(overwritten);
+                    current += overwritten * outputChannelNum;
+                }
+            }
+            producer.cachedHead = current;
+            break;
+        }
+        case overflowPolicy::grow       :
+        {
+            // The larger storage only counts once the consumer has switched to it, wait for that like block does.
+            const auto capacity = producer.storage->size();
+            const auto buffered = static_cast<std::size_t>(currentTail - producer.cachedHead);
+            const auto wanted   = std::max(capacity * 2, buffered + frames * outputChannelNum);
+            if (capacity < maxCapacity) setCapacity(std::min(wanted, maxCapacity));
+            if (latencyCapacity && producer.storage->size() > latencyCapacity)
+            {
+                grownCapacity = producer.storage->size();
+                applyLatency();
+            }
+            waitForSpace(frames);
+            producer.cachedHead = consumer.head.load(std::memory_order_acquire);
+            break;
+        }
+    }
+    return std::min(frames, freeFrames());
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::reportDropped(const std::size_t frames)
+{
+    producer.droppedFrames.store(producer.droppedFrames.load(std::memory_order_relaxed) + frames, std::memory_order_relaxed);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::waitForData(const std::size_t frames)
+{
+    // Consumer side, for non real-time readers only : the audio callback must keep using pop.
+    adoptFormat();
+    const auto needed      = frames * consumer.channels;
+    const auto currentHead = consumer.head.load(std::memory_order_relaxed);
+
+    return waitUntil(producer.tail, consumer.dataWaiters,
+                     [&](const std::uint64_t tail) { return static_cast<std::size_t>(tail - currentHead) >= needed; });
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+underrunStats audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::underruns() const
+{
+    return { consumer.underrunEvents.load(std::memory_order_relaxed), consumer.underrunFrames.load(std::memory_order_relaxed),
+             consumer.primingFrames .load(std::memory_order_relaxed) };
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::readSamples(std::span<T> data)
+{
+    adoptFormat();
+    if (layout == sampleLayout::held) return readHeld(data.data(), nullptr, data.size() / consumer.channels);
+    // A copy of frames the producer reclaimed under dropOldest meanwhile is redone from the head it left.
+    std::size_t frames = 0;
+    if (layout == sampleLayout::planar)
+    {
+        // Interleave straight from the planes into the caller's buffer.
+        do
+        {
+            frames = consumer.channels <= maxPlanarChannels ? acquire(data.size() / consumer.channels) : 0;
+            if (!frames) return 0;
+
+            const auto& storage   = *consumer.storage;
+            const auto  planeSize = storage.size() / consumer.channels;
+            const auto  start     = indexPolicy::slot(consumer.acquiredHead / consumer.channels, planeSize);
+            const auto  firstPart = std::min(frames, planeSize - start);
+
+            std::array<const T*, maxPlanarChannels> planes;
+            for (std::size_t c = 0; c < consumer.channels; c++) planes[c] = storage.data() + c * planeSize + start;
+            interleaveSamples(planes.data(), consumer.channels, 0, firstPart * consumer.channels, data.data());
+            for (std::size_t c = 0; c < consumer.channels; c++) planes[c] = storage.data() + c * planeSize;
+            interleaveSamples(planes.data(), consumer.channels, 0, (frames - firstPart) * consumer.channels, data.data() + firstPart * consumer.channels);
+        }
+        while (!consume(frames));
+        return frames;
+    }
+
+    do
+    {
+        const auto region = acquireRegion(data.size() / consumer.channels);
+        if (region.empty()) return 0;
+
+        std::copy(region.first .begin(), region.first .end(), data.begin());
+        std::copy(region.second.begin(), region.second.end(), data.begin() + region.first.size());
+        frames = region.size() / consumer.channels;
+    }
+    while (!consume(frames));
+
+    return frames;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::readPlanarSamples(std::span<T* const> channels, const std::size_t frames)
+{
+    // Planar output, for paNonInterleaved streams : one copy per channel, or a de-interleave from interleaved storage.
+    adoptFormat();
+    if (layout == sampleLayout::held) return readHeld(nullptr, channels.data(), frames);
+
+    // A copy of frames the producer reclaimed under dropOldest meanwhile is redone from the head it left.
+    std::size_t count = 0;
+    do
+    {
+        count = acquire(frames);
+        if (!count) return 0;
+
+        const auto& storage = *consumer.storage;
+        const auto  head    = consumer.acquiredHead;
+        if (layout == sampleLayout::planar)
+        {
+            const auto planeSize = storage.size() / consumer.channels;
+            const auto start     = indexPolicy::slot(head / consumer.channels, planeSize);
+            const auto firstPart = std::min(count, planeSize - start);
+            for (std::size_t c = 0; c < consumer.channels; c++)
+            {
+                const auto plane = storage.data() + c * planeSize;
+                std::copy_n(plane + start, firstPart,         channels[c]);
+                std::copy_n(plane,         count - firstPart, channels[c] + firstPart);
+            }
+        }
+        else
+        {
+            const auto start     = indexPolicy::slot(head, storage.size());
+            const auto firstPart = std::min(count * consumer.channels, storage.size() - start);
+            deinterleaveSamples(storage.data() + start, consumer.channels, 0,         firstPart,                            channels.data());
+            deinterleaveSamples(storage.data(),         consumer.channels, firstPart, count * consumer.channels - firstPart, channels.data());
+        }
+    }
+    while (!consume(count));
+
+    return count;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::read(std::span<T> data)
+{
+    const auto frames = readSamples(data);
+    applyGain(data.data(), nullptr, frames);
+    return frames;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+std::size_t audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::readPlanar(std::span<T* const> channels, const std::size_t frames)
+{
+    adoptFormat();
+    if (channels.size() < consumer.channels) return 0;
+
+    const auto count = readPlanarSamples(channels, frames);
+    applyGain(nullptr, channels.data(), count);
+    return count;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::push(T*&& ptr, std::size_t frames, const std::size_t targetChannelNum, const std::size_t targetSampleRate, const mediaTicks timestamp)
 {   
-    /*
-    const bool needChannelConversion = (outputChannelNum != channelNum);
-    */
-    const auto needResample          = (outputSampleRate != audioSampleRate); 
+    // A held queue only takes buffers through hold.
+    if (layout == sampleLayout::held)
+    {
+        reportDropped(frames);
+        return;
+    }
+    const auto needChannelConversion = (targetChannelNum != channelNum);
+    const auto needResample          = (targetSampleRate != audioSampleRate) || driftEnabled; 
+    const auto convertFirst          = (targetChannelNum <  channelNum);
     const auto currentSize           = frames * channelNum;
     
-    std::vector<T> temp;
-    std::move(ptr, ptr + currentSize, std::back_inserter(temp));
-    /*
-    if (needChannelConversion)
+    if (!changeFormat(targetChannelNum, targetSampleRate))
+    {
+        reportDropped(frames);
+        return;
+    }
+    std::span<const T> data(ptr, currentSize);
+    tuneLatency(frames);
+    updateDrift(frames);
+
+    const auto late = alignTimeline(timestamp, frames);
+    if (late == frames) return;
+    data = data.subspan(late * channelNum);
+
+    // Down-mixes run before the resampler and up-mixes after it, so it always works on the fewest channels.
+    if (needChannelConversion && convertFirst)
     {
-        channelConversion(temp, outputChannelNum);
-    }*/
+        data = channelConversion(data, targetChannelNum);
+    }
     if (needResample)
     {
-        resample(temp, frames, outputSampleRate);
+        data = resample(data, convertFirst ? targetChannelNum : channelNum, targetSampleRate);
+    }
+    if (needChannelConversion && !convertFirst)
+    {
+        data = channelConversion(data, targetChannelNum);
     }
     
-    const auto finalSize = temp.size();
-    const auto estimatedUsage = usage.load() + (finalSize * 100 / queue.size());
+    // Overwriting keeps the newest frames, a block larger than the whole queue loses its head first.
+    auto       totalFrames = data.size() / outputChannelNum;
+    const auto fitFrames   = writableCapacity() / outputChannelNum;
+    if (overflowMode() == overflowPolicy::dropOldest && totalFrames > fitFrames)
+    {
+        const auto skipped = totalFrames - fitFrames;
+        reportDropped(skipped);
+        data         = data.subspan(skipped * outputChannelNum);
+        totalFrames -= skipped;
+    }
 
-    if (estimatedUsage >= upperThreshold) std::this_thread::sleep_for(std::chrono::milliseconds(inputDelay));
-    for (auto i = 0; i < finalSize; i++)
+    // Write what the overflow policy lets in, whatever is left is counted as dropped.
+    std::size_t pushedFrames = 0;
+    while (pushedFrames < totalFrames)
     {
-        if (!(this->enqueue(temp[i])))
-        {
-            std::print("Warning : push operation aborted, {} elements are pushed.\n",i+1);
-            break;
-        }
+        const auto room    = makeRoom(totalFrames - pushedFrames);
+        const auto written = room ? write(data.subspan(pushedFrames * outputChannelNum, room * outputChannelNum)) : 0;
+        if (!written) break;
+        pushedFrames += written;
     }
-    usageRefresh();
+    if (pushedFrames < totalFrames) reportDropped(totalFrames - pushedFrames);
 }
 
-template<audioType T>
-void audioQueue<T>::pop(T*& ptr, std::size_t frames,const bool mode)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::pop(T*& ptr, std::size_t frames)
 {   
-    const auto size = frames * channelNum;
-    const auto estimatedUsage = usage.load() >= (size * 100 / queue.size()) ? usage.load() - (size * 100 / queue.size()) : 0;
-    
-    if (estimatedUsage <= lowerThreshold) std::this_thread::sleep_for(std::chrono::milliseconds(outputDelay));
-    for (auto i = 0; i < size; i++)
+    // Real-time safe : returns immediately with what is in the queue and conceals the rest.
+    // Several queues are summed into one buffer by audioMixer.
+    adoptFormat();
+    const auto size        = frames * consumer.channels;
+    const auto popedFrames = read({ ptr, size });
+    if (popedFrames < frames) conceal({ ptr + popedFrames * consumer.channels, size - popedFrames * consumer.channels });
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::clear()
+{
+    // Producer thread, once the consumer has stopped reading : the buffered frames are dropped without being
+    // counted, and every held buffer goes back to its owner now instead of waiting for a read that will not come.
+    const auto tail = producer.tail.load(std::memory_order_relaxed);
+    consumer.head.store(tail, std::memory_order_release);
+    consumer.acquiredHead = tail;
+    consumer.cachedTail   = tail;
+    consumer.playing      = false;
+    consumer.heldOffset   = 0;
+    consumer.heldHead.store(producer.heldTail, std::memory_order_release);
+    producer.cachedHead   = tail;
+    reclaim();
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::reserveScratch(const std::size_t frames)
+{
+    // Producer thread only. Sizes the conversion buffer and the resampler for input blocks of up to frames frames
+    // in the current formats, so that push does not allocate once the stream is running.
+    if (!audioSampleRate || !outputSampleRate) return;
+
+    const auto channels = std::max(channelNum, outputChannelNum);
+    const auto ratio    = static_cast<double>(outputSampleRate) / static_cast<double>(audioSampleRate) * (1.0 + driftMaxPpm * 1e-6);
+    const auto expected = static_cast<std::size_t>(std::ceil(static_cast<double>(frames) * std::max(ratio, 1.0))) + 2;
+
+    if (conversionBuffer.size() < expected * channels) conversionBuffer.resize(expected * channels);
+    resampler.reserve(frames, channels, ratio);
+    if constexpr (!std::same_as<T, float>)
     {
-       if (!this->dequeue(ptr[i],mode)) 
-       {
-           std::print("Warning : there is only {} elements were poped, {} demanded.\n", i, size);
-           break;
-       }
+        if (floatBuffer   .size() < frames   * channels) floatBuffer   .resize(frames   * channels);
+        if (resampleBuffer.size() < expected * channels) resampleBuffer.resize(expected * channels);
     }
-    usageRefresh();
 }
 
-template<audioType T>
-inline void audioQueue<T>::setCapacity(std::size_t newCapacity)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setDriftCompensation(const bool enable, const double maxPpm)
+{
+    // Producer thread only. The controller needs a target latency, see setLatency.
+    driftEnabled  = enable;
+    driftMaxPpm   = maxPpm;
+    driftFill     = static_cast<double>(targetFill.load(std::memory_order_relaxed) / std::max<std::size_t>(outputChannelNum, 1)) * 1000.0 / static_cast<double>(std::max<std::size_t>(outputSampleRate, 1));
+    driftIntegral = 0.0;
+    driftEstimate.store(0.0, std::memory_order_relaxed);
+    resampler.setVariableRatio(enable);
+    resampler.setCorrection(1.0);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setJitterBuffer(const bool enable)
+{
+    // Producer thread only. The presentation delay is the target latency, see setLatency.
+    nextTimestamp = untimed;
+    jitterEnabled.store(enable, std::memory_order_relaxed);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setAdaptiveLatency(const bool enable, const std::chrono::milliseconds minimum, const std::chrono::milliseconds maximum)
+{
+    // Producer thread only. The tuned target starts from the configured one and stays under the maximum latency.
+    if (minimum > maximum || (latency.maximum.count() > 0 && maximum > latency.maximum))
+    {
+        std::print("Latency error : the tuning bounds must be ordered and under the maximum latency, tuning not set.\n");
+        return;
+    }
+    tuner.enabled       = enable;
+    tuner.minimum       = static_cast<double>(minimum.count());
+    tuner.maximum       = static_cast<double>(maximum.count());
+    tuner.target        = std::clamp(static_cast<double>(latency.target.count()), tuner.minimum, tuner.maximum);
+    tuner.stableTime    = 0.0;
+    tuner.lastArrival   = {};
+    tuner.seenUnderruns = consumer.underrunEvents.load(std::memory_order_relaxed);
+    tuner.seenDrops     = producer.droppedFrames .load(std::memory_order_relaxed);
+    tuner.jitter.store(0.0, std::memory_order_relaxed);
+    applyLatency();
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+jitterStats audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::jitter() const
+{
+    return { producer.gapFrames.load(std::memory_order_relaxed), producer.lateFrames.load(std::memory_order_relaxed), producer.resyncs.load(std::memory_order_relaxed) };
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+double audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::targetLatency() const
+{
+    // Any thread : the output format is read from what changeFormat published, never from the producer's fields.
+    const auto rate     = resize.sampleRate.load(std::memory_order_acquire);
+    const auto channels = std::max<std::size_t>(resize.channels.load(std::memory_order_acquire), 1);
+    return rate ? static_cast<double>(targetSize() / channels) * 1000.0 / static_cast<double>(rate) : 0.0;
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setLatency(const latencySettings& settings)
+{
+    // Producer thread only, the capacity follows the output format from now on.
+    if (settings.target > settings.maximum || settings.headroom.count() < 0)
+    {
+        std::print("Latency error : the target latency must not exceed the maximum latency, latency not set.\n");
+        return;
+    }
+    latency       = settings;
+    grownCapacity = 0;
+    applyLatency();
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+inline void audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setCapacity(std::size_t newCapacity)
 {   
-    if (newCapacity == queue.size()) return;
-    else
+    // Producer thread only. An unchanged capacity returns at once. While the previous resize is not acknowledged
+    // or while the buffered frames would not fit, the request is kept pending and retried by reserve and makeRoom,
+    // a later request replaces it.
+    const auto capacity = storageSizeFor(newCapacity);
+    pendingCapacity = 0;
+    if (capacity == producer.storage->size()) return;
+
+    reclaim();
+    const auto currentHead = consumer.head.load(std::memory_order_acquire);
+    const auto currentTail = producer.tail.load(std::memory_order_relaxed);
+    if (producer.retired || currentTail - currentHead > usableSize(capacity))
     {
-        if (this->size()) this->clear();
-        queue.resize(newCapacity);
+        pendingCapacity = newCapacity;
+        return;
     }
+
+    // Buffered samples keep their monotonic indices and are copied to their slots in the new storage,
+    // samples consumed meanwhile are copied for nothing but never read.
+    auto  resized = std::make_unique<ringStorage>(capacity);
+    auto& current = *producer.storage;
+    for (auto index = currentHead; index < currentTail; index++)
+        (*resized)[slotOf(index, capacity, outputChannelNum)] = current[slotOf(index, current.size(), outputChannelNum)];
+
+    producer.retired = std::move(producer.storage);
+    producer.storage = std::move(resized);
+    resize.published.store(producer.storage.get(), std::memory_order_release);
+    resize.channels .store(outputChannelNum,       std::memory_order_release);
 }
 
-template<audioType T>
-inline void audioQueue<T>::setDelay(const std::uint8_t lower, const std::uint8_t upper, const std::size_t iDelay, const std::size_t oDelay)
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setChannelMatrix(std::span<const float> gains)
+{
+    // Producer thread only, like changeFormat : push converts with the matrix and nothing guards it against a
+    // concurrent swap. The gains are outputs x inputs for the current channel counts, a later change of either
+    // count brings back the default matrix of the new layout.
+    return matrix.setGains(gains, channelNum, outputChannelNum);
+}
+
+template<audioType T, typename indexPolicy, typename storagePolicy, typename waitPolicy, typename overflowHandling>
+bool audioQueue<T, indexPolicy, storagePolicy, waitPolicy, overflowHandling>::setLayout(const sampleLayout newLayout)
 {
-    auto isInRange = [](const std::uint8_t val) { return val >= 0 && val <= 100; };
-    if (isInRange(lowerThreshold) && isInRange(upperThreshold))
+    // Producer thread only, while the queue is empty : the buffered samples would be read with the wrong layout.
+    if (newLayout == layout) return true;
+    if (size() || (newLayout != sampleLayout::interleaved && outputChannelNum > maxPlanarChannels))
     {
-        lowerThreshold = lower;
-        upperThreshold = upper;
-        inputDelay     = iDelay;
-        outputDelay    = oDelay;
+        std::print("Layout error : the queue must be empty and have at most {} channels to change its layout.\n", maxPlanarChannels);
+        return false;
     }
-    else std::print("The upper and lower threshold must between 0% and 100% ! Threshold not set. ");
+    reclaim();
+    layout = newLayout;
+    setCapacity(producer.storage->size());
+
+    return true;
 }
 #pragma endregion
 
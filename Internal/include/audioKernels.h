@@ -0,0 +1,582 @@
+#ifndef audioKernels_H
+#define audioKernels_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "sampleTypes.h"
+
+/**
+ * @brief Instruction set selection for the DSP kernels.
+ *
+ * AVX2 is used when the compiler targets it (/arch:AVX2, -mavx2 -mfma), SSE2 is the x64 baseline,
+ * everything else falls back to the scalar loops.
+ */
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define AUDIO_KERNEL_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace audioKernels
+{
+#pragma region Horizontal sums
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+    inline float horizontalSum(const __m128 value)
+    {
+        const auto pairs = _mm_add_ps(value, _mm_movehl_ps(value, value));
+        return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 0x55)));
+    }
+#endif
+#if defined(AUDIO_KERNEL_AVX2)
+    inline float horizontalSum(const __m256 value) { return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1))); }
+#endif
+#pragma endregion
+
+#pragma region Dot product
+    /**
+     * @brief Scalar reference of dotProduct.
+     */
+    inline float dotProductScalar(const float* a, const float* b, const std::size_t size)
+    {
+        float result = 0.0f;
+        for (std::size_t i = 0; i < size; i++) result += a[i] * b[i];
+        return result;
+    }
+
+    /**
+     * @brief Sum of a[i] * b[i] over size elements, no alignment requirement.
+     */
+    inline float dotProduct(const float* a, const float* b, const std::size_t size)
+    {
+        std::size_t i      = 0;
+        float       result = 0.0f;
+#if defined(AUDIO_KERNEL_AVX2)
+        auto acc0 = _mm256_setzero_ps();
+        auto acc1 = _mm256_setzero_ps();
+        for (; i + 16 <= size; i += 16)
+        {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i    ), _mm256_loadu_ps(b + i    ), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        }
+        for (; i + 8 <= size; i += 8) acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        result = horizontalSum(_mm256_add_ps(acc0, acc1));
+#elif defined(AUDIO_KERNEL_SSE2)
+        auto acc0 = _mm_setzero_ps();
+        auto acc1 = _mm_setzero_ps();
+        for (; i + 8 <= size; i += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i    ), _mm_loadu_ps(b + i    )));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        for (; i + 4 <= size; i += 4) acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        result = horizontalSum(_mm_add_ps(acc0, acc1));
+#endif
+        return result + dotProductScalar(a + i, b + i, size - i);
+    }
+#pragma endregion
+
+#pragma region Channel mixing
+    /**
+     * @brief Mono to stereo : out[2i] = in[i] * left, out[2i + 1] = in[i] * right.
+     */
+    inline void monoToStereo(const float* in, float* out, const std::size_t frames, const float left, const float right)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto gainL = _mm_set1_ps(left);
+        const auto gainR = _mm_set1_ps(right);
+        for (; i + 4 <= frames; i += 4)
+        {
+            const auto mono = _mm_loadu_ps(in + i);
+            const auto l    = _mm_mul_ps(mono, gainL);
+            const auto r    = _mm_mul_ps(mono, gainR);
+            _mm_storeu_ps(out + 2 * i,     _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#endif
+        for (; i < frames; i++)
+        {
+            out[2 * i]     = in[i] * left;
+            out[2 * i + 1] = in[i] * right;
+        }
+    }
+
+    /**
+     * @brief Stereo to mono : out[i] = in[2i] * left + in[2i + 1] * right.
+     */
+    inline void stereoToMono(const float* in, float* out, const std::size_t frames, const float left, const float right)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto gainL = _mm_set1_ps(left);
+        const auto gainR = _mm_set1_ps(right);
+        for (; i + 4 <= frames; i += 4)
+        {
+            const auto low  = _mm_loadu_ps(in + 2 * i);
+            const auto high = _mm_loadu_ps(in + 2 * i + 4);
+            const auto l    = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+            const auto r    = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(l, gainL), _mm_mul_ps(r, gainR)));
+        }
+#endif
+        for (; i < frames; i++) out[i] = in[2 * i] * left + in[2 * i + 1] * right;
+    }
+
+    /**
+     * @brief Fixed layout down-mix to stereo, the channel count is a compile-time constant
+     * so every frame is a fully unrolled pair of short dot products.
+     */
+    template<std::size_t inputs>
+    inline void mixToStereo(const float* in, float* out, const std::size_t frames, const float* gainsL, const float* gainsR)
+    {
+        constexpr std::size_t vectorized = inputs / 4 * 4;
+        for (std::size_t f = 0; f < frames; f++, in += inputs, out += 2)
+        {
+            float       l = 0.0f;
+            float       r = 0.0f;
+            std::size_t c = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+            if constexpr (vectorized > 0)
+            {
+                auto accL = _mm_setzero_ps();
+                auto accR = _mm_setzero_ps();
+                for (; c < vectorized; c += 4)
+                {
+                    const auto frame = _mm_loadu_ps(in + c);
+                    accL = _mm_add_ps(accL, _mm_mul_ps(frame, _mm_loadu_ps(gainsL + c)));
+                    accR = _mm_add_ps(accR, _mm_mul_ps(frame, _mm_loadu_ps(gainsR + c)));
+                }
+                l = horizontalSum(accL);
+                r = horizontalSum(accR);
+            }
+#endif
+            for (; c < inputs; c++)
+            {
+                l += in[c] * gainsL[c];
+                r += in[c] * gainsR[c];
+            }
+            out[0] = l;
+            out[1] = r;
+        }
+    }
+
+    /**
+     * @brief Planar stereo to interleaved : out[2i] = left[i], out[2i + 1] = right[i].
+     */
+    inline void interleaveStereo(const float* left, const float* right, float* out, const std::size_t frames)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        for (; i + 4 <= frames; i += 4)
+        {
+            const auto l = _mm_loadu_ps(left  + i);
+            const auto r = _mm_loadu_ps(right + i);
+            _mm_storeu_ps(out + 2 * i,     _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+        }
+#endif
+        for (; i < frames; i++)
+        {
+            out[2 * i]     = left [i];
+            out[2 * i + 1] = right[i];
+        }
+    }
+
+    /**
+     * @brief Interleaved stereo to planar : left[i] = in[2i], right[i] = in[2i + 1].
+     */
+    inline void deinterleaveStereo(const float* in, float* left, float* right, const std::size_t frames)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        for (; i + 4 <= frames; i += 4)
+        {
+            const auto low  = _mm_loadu_ps(in + 2 * i);
+            const auto high = _mm_loadu_ps(in + 2 * i + 4);
+            _mm_storeu_ps(left  + i, _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + i, _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+#endif
+        for (; i < frames; i++)
+        {
+            left [i] = in[2 * i];
+            right[i] = in[2 * i + 1];
+        }
+    }
+
+    /**
+     * @brief Copy the first outputs channels of every frame, the rest is dropped.
+     */
+    inline void channelSubset(const float* in, float* out, const std::size_t frames, const std::size_t inputs, const std::size_t outputs)
+    {
+        for (std::size_t f = 0; f < frames; f++, in += inputs, out += outputs)
+            for (std::size_t c = 0; c < outputs; c++) out[c] = in[c];
+    }
+#pragma endregion
+
+#pragma region Sample conversion
+    /**
+     * @brief Scalar reference of shortToFloat.
+     */
+    inline void shortToFloatScalar(const short* in, float* out, const std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) out[i] = static_cast<float>(in[i]) * (1.0f / 32768.0f);
+    }
+
+    /**
+     * @brief int16 to float in [-1, 1).
+     */
+    inline void shortToFloat(const short* in, float* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto scale = _mm_set1_ps(1.0f / 32768.0f);
+        for (; i + 8 <= size; i += 8)
+        {
+            const auto samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            _mm_storeu_ps(out + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)), scale));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)), scale));
+        }
+#endif
+        shortToFloatScalar(in + i, out + i, size - i);
+    }
+
+    /**
+     * @brief Scalar reference of floatToShort.
+     */
+    inline void floatToShortScalar(const float* in, short* out, const std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) out[i] = static_cast<short>(std::lrint(std::clamp(in[i] * 32768.0f, -32768.0f, 32767.0f)));
+    }
+
+    /**
+     * @brief float to int16, rounded to nearest and saturated.
+     */
+    inline void floatToShort(const float* in, short* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto scale  = _mm_set1_ps(32768.0f);
+        const auto lowest = _mm_set1_ps(-32768.0f);
+        const auto top    = _mm_set1_ps( 32767.0f);
+        const auto toInt  = [&](const float* source) { return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(source), scale), lowest), top)); };
+        for (; i + 8 <= size; i += 8) _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(toInt(in + i), toInt(in + i + 4)));
+#endif
+        floatToShortScalar(in + i, out + i, size - i);
+    }
+
+    /**
+     * @brief int32 to float in [-1, 1).
+     */
+    inline void int32ToFloat(const std::int32_t* in, float* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto scale = _mm_set1_ps(1.0f / 2147483648.0f);
+        for (; i + 4 <= size; i += 4) _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))), scale));
+#endif
+        for (; i < size; i++) out[i] = static_cast<float>(toNormalized(in[i]));
+    }
+
+    /**
+     * @brief float to int32, rounded to nearest and saturated. The conversion overflows to INT32_MIN
+     * at +1.0 and above, those lanes are replaced by INT32_MAX.
+     */
+    inline void floatToInt32(const float* in, std::int32_t* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto scale   = _mm_set1_ps(2147483648.0f);
+        const auto lowest  = _mm_set1_ps(-2147483648.0f);
+        const auto largest = _mm_set1_epi32(INT32_MAX);
+        for (; i + 4 <= size; i += 4)
+        {
+            const auto scaled    = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), lowest);
+            const auto overflow  = _mm_castps_si128(_mm_cmpge_ps(scaled, scale));
+            const auto converted = _mm_or_si128(_mm_andnot_si128(overflow, _mm_cvtps_epi32(scaled)), _mm_and_si128(overflow, largest));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), converted);
+        }
+#endif
+        for (; i < size; i++) out[i] = fromNormalized<std::int32_t>(in[i]);
+    }
+
+    /**
+     * @brief float to double and back, two samples per conversion.
+     */
+    inline void floatToDouble(const float* in, double* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        for (; i + 4 <= size; i += 4)
+        {
+            const auto samples = _mm_loadu_ps(in + i);
+            _mm_storeu_pd(out + i,     _mm_cvtps_pd(samples));
+            _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(samples, samples)));
+        }
+#endif
+        for (; i < size; i++) out[i] = in[i];
+    }
+
+    inline void doubleToFloat(const double* in, float* out, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        for (; i + 4 <= size; i += 4) _mm_storeu_ps(out + i, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in + i)), _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2))));
+#endif
+        for (; i < size; i++) out[i] = static_cast<float>(in[i]);
+    }
+
+    /**
+     * @brief Scalar reference of convertSamples, every pair goes through a normalized double.
+     */
+    template<typename From, typename To>
+    inline void convertSamplesScalar(const From* in, To* out, const std::size_t size)
+    {
+        for (std::size_t i = 0; i < size; i++) out[i] = fromNormalized<To>(toNormalized(in[i]));
+    }
+
+    /**
+     * @brief Sample format conversion, the kernel is chosen at compile time for each source and destination pair.
+     * Pairs without a vector kernel use the scalar reference.
+     */
+    template<typename From, typename To>
+    inline void convertSamples(const From* in, To* out, const std::size_t size)
+    {
+             if constexpr (std::same_as<From, To>)                                          std::copy_n(in, size, out);
+        else if constexpr (std::same_as<From, short>        && std::same_as<To, float>)        shortToFloat (in, out, size);
+        else if constexpr (std::same_as<From, float>        && std::same_as<To, short>)        floatToShort (in, out, size);
+        else if constexpr (std::same_as<From, std::int32_t> && std::same_as<To, float>)        int32ToFloat (in, out, size);
+        else if constexpr (std::same_as<From, float>        && std::same_as<To, std::int32_t>) floatToInt32 (in, out, size);
+        else if constexpr (std::same_as<From, float>        && std::same_as<To, double>)       floatToDouble(in, out, size);
+        else if constexpr (std::same_as<From, double>       && std::same_as<To, float>)        doubleToFloat(in, out, size);
+        else                                                                                   convertSamplesScalar(in, out, size);
+    }
+#pragma endregion
+
+#pragma region Source mixing
+    /**
+     * @brief Scalar reference of mixAdd for float samples.
+     */
+    inline void mixAddScalar(const float* in, float* out, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++) out[i] += in[i] * gain;
+    }
+
+    /**
+     * @brief out[i] += in[i] * gain, one fused multiply-add per sample on AVX2.
+     */
+    inline void mixAdd(const float* in, float* out, const std::size_t size, const float gain)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2)
+        const auto factor = _mm256_set1_ps(gain);
+        for (; i + 8 <= size; i += 8) _mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_loadu_ps(in + i), factor, _mm256_loadu_ps(out + i)));
+#elif defined(AUDIO_KERNEL_SSE2)
+        const auto factor = _mm_set1_ps(gain);
+        for (; i + 4 <= size; i += 4) _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), factor)));
+#endif
+        mixAddScalar(in + i, out + i, size - i, gain);
+    }
+
+    /**
+     * @brief Scalar reference of mixAdd for int16 samples : the scaled input and the sum both saturate.
+     */
+    inline void mixAddScalar(const short* in, short* out, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++)
+        {
+            const auto scaled = std::lrint(std::clamp(static_cast<float>(in[i]) * gain, -32768.0f, 32767.0f));
+            out[i] = static_cast<short>(std::clamp<long>(out[i] + scaled, -32768, 32767));
+        }
+    }
+
+    /**
+     * @brief out[i] += in[i] * gain on int16 samples with saturation, 8 samples per step.
+     */
+    inline void mixAdd(const short* in, short* out, const std::size_t size, const float gain)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto factor = _mm_set1_ps(gain);
+        const auto lowest = _mm_set1_ps(-32768.0f);
+        const auto top    = _mm_set1_ps( 32767.0f);
+        const auto scale  = [&](const __m128i samples)
+        {
+            const auto scaled = _mm_mul_ps(_mm_cvtepi32_ps(samples), factor);
+            return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(scaled, lowest), top));
+        };
+        for (; i + 8 <= size; i += 8)
+        {
+            const auto samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            const auto low     = scale(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+            const auto high    = scale(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16));
+            const auto current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_adds_epi16(current, _mm_packs_epi32(low, high)));
+        }
+#endif
+        mixAddScalar(in + i, out + i, size - i, gain);
+    }
+
+    /**
+     * @brief out[i] += in[i] * gain for the other sample types, through normalized doubles with saturation.
+     */
+    template<typename T>
+    inline void mixAdd(const T* in, T* out, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++) out[i] = fromNormalized<T>(toNormalized(out[i]) + toNormalized(in[i]) * gain);
+    }
+
+    /**
+     * @brief Scalar reference of softClip : linear up to the knee, then a quadratic bend reaching full scale
+     * with a zero slope at 1.2, hard-limited above it.
+     */
+    inline constexpr float softClipKnee = 0.8f;
+    inline constexpr float softClipTop  = 2.0f - softClipKnee;
+    inline constexpr float softClipBend = 1.0f / (4.0f * (1.0f - softClipKnee));
+
+    inline float softClipScalar(const float sample)
+    {
+        const auto magnitude = std::min(std::abs(sample), softClipTop);
+        const auto over      = std::max(magnitude - softClipKnee, 0.0f);
+        return std::copysign(magnitude - over * over * softClipBend, sample);
+    }
+
+    /**
+     * @brief Soft-clip a mixed block in place so that overs bend into full scale instead of wrapping or clipping hard.
+     * Samples under the knee (-1.9 dBFS) are left untouched.
+     */
+    inline void softClip(float* data, const std::size_t size)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto signBit = _mm_set1_ps(-0.0f);
+        const auto knee    = _mm_set1_ps(softClipKnee);
+        const auto top     = _mm_set1_ps(softClipTop);
+        const auto bend    = _mm_set1_ps(softClipBend);
+        for (; i + 4 <= size; i += 4)
+        {
+            const auto x         = _mm_loadu_ps(data + i);
+            const auto magnitude = _mm_min_ps(_mm_andnot_ps(signBit, x), top);
+            const auto over      = _mm_max_ps(_mm_sub_ps(magnitude, knee), _mm_setzero_ps());
+            const auto bent      = _mm_sub_ps(magnitude, _mm_mul_ps(_mm_mul_ps(over, over), bend));
+            _mm_storeu_ps(data + i, _mm_or_ps(bent, _mm_and_ps(signBit, x)));
+        }
+#endif
+        for (; i < size; i++) data[i] = softClipScalar(data[i]);
+    }
+#pragma endregion
+
+#pragma region Gain
+    /**
+     * @brief Scalar reference of applyGain.
+     */
+    inline void applyGainScalar(float* data, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++) data[i] *= gain;
+    }
+
+    /**
+     * @brief data[i] *= gain.
+     */
+    inline void applyGain(float* data, const std::size_t size, const float gain)
+    {
+        std::size_t i = 0;
+#if defined(AUDIO_KERNEL_AVX2)
+        const auto factor = _mm256_set1_ps(gain);
+        for (; i + 8 <= size; i += 8) _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), factor));
+#elif defined(AUDIO_KERNEL_SSE2)
+        const auto factor = _mm_set1_ps(gain);
+        for (; i + 4 <= size; i += 4) _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), factor));
+#endif
+        applyGainScalar(data + i, size - i, gain);
+    }
+
+    /**
+     * @brief int16 gain, rounded and saturated.
+     */
+    inline void applyGain(short* data, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++) data[i] = static_cast<short>(std::lrint(std::clamp(static_cast<float>(data[i]) * gain, -32768.0f, 32767.0f)));
+    }
+
+    /**
+     * @brief Gain for the other sample types, through normalized doubles with saturation.
+     */
+    template<typename T>
+    inline void applyGain(T* data, const std::size_t size, const float gain)
+    {
+        for (std::size_t i = 0; i < size; i++) data[i] = fromNormalized<T>(toNormalized(data[i]) * gain);
+    }
+
+    /**
+     * @brief Scalar reference of gainRamp.
+     */
+    inline void gainRampScalar(float* data, const std::size_t frames, const std::size_t channels, const float start, const float step)
+    {
+        for (std::size_t f = 0; f < frames; f++)
+        {
+            const auto gain = start + step * static_cast<float>(f + 1);
+            for (std::size_t c = 0; c < channels; c++) data[f * channels + c] *= gain;
+        }
+    }
+
+    /**
+     * @brief Linear gain ramp over interleaved frames : frame f is scaled by start + step * (f + 1),
+     * so the last frame of a ramp lands on its target. Vectorized for 1, 2, 4 and multiples of 4 channels.
+     */
+    inline void gainRamp(float* data, const std::size_t frames, const std::size_t channels, const float start, const float step)
+    {
+        std::size_t f = 0;
+#if defined(AUDIO_KERNEL_AVX2) || defined(AUDIO_KERNEL_SSE2)
+        const auto first = _mm_set1_ps(start);
+        const auto slope = _mm_set1_ps(step);
+        if (channels == 1 || channels == 2 || channels == 4)
+        {
+            // Each vector covers 4 / channels frames, lane k belongs to frame k / channels.
+            const auto perVector = 4 / channels;
+            const auto lanes     = _mm_set_ps(static_cast<float>(3 / channels + 1), static_cast<float>(2 / channels + 1), 
+                                              static_cast<float>(1 / channels + 1), 1.0f);
+            for (; f + perVector <= frames; f += perVector)
+            {
+                const auto gains = _mm_add_ps(first, _mm_mul_ps(slope, _mm_add_ps(_mm_set1_ps(static_cast<float>(f)), lanes)));
+                _mm_storeu_ps(data + f * channels, _mm_mul_ps(_mm_loadu_ps(data + f * channels), gains));
+            }
+        }
+        else if (channels % 4 == 0)
+        {
+            for (; f < frames; f++)
+            {
+                const auto gain = _mm_set1_ps(start + step * static_cast<float>(f + 1));
+                for (std::size_t c = 0; c < channels; c += 4)
+                    _mm_storeu_ps(data + f * channels + c, _mm_mul_ps(_mm_loadu_ps(data + f * channels + c), gain));
+            }
+        }
+#endif
+        gainRampScalar(data + f * channels, frames - f, channels, start + step * static_cast<float>(f), step);
+    }
+
+    /**
+     * @brief int16 gain ramp, rounded and saturated.
+     */
+    inline void gainRamp(short* data, const std::size_t frames, const std::size_t channels, const float start, const float step)
+    {
+        for (std::size_t f = 0; f < frames; f++) applyGain(data + f * channels, channels, start + step * static_cast<float>(f + 1));
+    }
+
+    /**
+     * @brief Gain ramp for the other sample types.
+     */
+    template<typename T>
+    inline void gainRamp(T* data, const std::size_t frames, const std::size_t channels, const float start, const float step)
+    {
+        for (std::size_t f = 0; f < frames; f++) applyGain(data + f * channels, channels, start + step * static_cast<float>(f + 1));
+    }
+#pragma endregion
+}
+
+#endif// audioKernels_H
@@ -0,0 +1,141 @@
+#ifndef audioMixer_H
+#define audioMixer_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <print>
+#include <span>
+#include <vector>
+
+#include "audioFrame.h"
+#include "audioKernels.h"
+
+inline constexpr std::size_t maxMixInputs = 16;
+
+/**
+ * @brief Sums several audioQueue outputs into one interleaved device block.
+ *
+ * Every input has its own gain and mute on top of the queue gain, both can be changed from any thread while mixing. An interleaved queue
+ * is accumulated straight from its ring storage with one multiply-add pass, planar and held queues are read into
+ * a scratch block first. Missing frames are concealed by the input's underrun policy before being mixed.
+ * Float output can be soft-clipped, int16 output always saturates.
+ * Inputs are added before the audio starts, mix is called from the audio callback only. queuePolicies are the
+ * policies of the mixed queues, after the sample type.
+ */
+template<audioType T, typename... queuePolicies>
+class audioMixer
+{
+    private : //Class members
+    struct mixInput
+    {
+audioQueue<T, queuePolicies...>* queue = nullptr;
+         std::atomic<float>  gain  = 1.0f;
+          std::atomic<bool>  muted = false;
+    };
+
+                std::size_t  channelNum;
+                std::size_t  blockFrames;
+std::array<mixInput, maxMixInputs> inputs;
+   std::atomic<std::size_t>  inputNum;
+          std::atomic<bool>  clipping;
+             std::vector<T>  scratch;
+
+    public : //Public member functions
+                             audioMixer         (const  std:: size_t    channels,
+                                                 const  std:: size_t    maxFrames);
+                             audioMixer         (const audioMixer&) = delete;
+                 audioMixer& operator=          (const audioMixer&) = delete;
+
+                std::size_t  addInput           (audioQueue<T, queuePolicies...>& queue,
+                                                 const          float   gain = 1.0f);
+                       void  mix                (      std::span<T>         output);
+
+    inline             void  setGain            (const  std:: size_t    input,
+                                                 const          float   gain){ if (input < maxMixInputs) inputs[input].gain.store(gain, std::memory_order_relaxed); }
+    inline             void  setMute            (const  std:: size_t    input,
+                                                 const          bool    mute){ if (input < maxMixInputs) inputs[input].muted.store(mute, std::memory_order_relaxed); }
+    inline             void  setSoftClip        (const          bool    enable){ clipping.store(enable, std::memory_order_relaxed); }
+
+    inline      std::size_t  channels           () const { return channelNum; }
+    inline      std::size_t  size               () const { return inputNum.load(std::memory_order_acquire); }
+
+    private : //Private member functions
+                       void  mixBlock           (      std::span<T>         output);
+};
+
+#pragma region Constructors
+template<audioType T, typename... queuePolicies>
+audioMixer<T, queuePolicies...>::audioMixer(const std::size_t channels, const std::size_t maxFrames)
+    :   channelNum(std::max<std::size_t>(channels, 1)), blockFrames(std::max<std::size_t>(maxFrames, 1)), inputNum(0), clipping(false),
+        scratch(blockFrames * channelNum) {}
+#pragma endregion
+
+#pragma region Private member functions
+template<audioType T, typename... queuePolicies>
+void audioMixer<T, queuePolicies...>::mixBlock(std::span<T> output)
+{
+    const auto frames = output.size() / channelNum;
+    const auto count  = inputNum.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        auto& input = inputs[i];
+        auto& queue = *input.queue;
+        if (input.muted.load(std::memory_order_relaxed) || queue.outputChannels() != channelNum) continue;
+
+        // Interleaved storage is mixed in one pass per segment straight from the ring, with the queue gain folded
+        // into the input gain. The other layouts, queues ramping their gain and dropOldest queues, which peek refuses,
+        // are read into the scratch block.
+        // Missing frames are concealed in the scratch block after them.
+        const auto  gain   = input.gain.load(std::memory_order_relaxed);
+        const auto  block  = std::span<T>(scratch).first(frames * channelNum);
+        std::size_t done   = 0;
+        std::size_t direct = 0;
+        if (const auto region = queue.gainSettled() ? queue.peek(frames) : ringRegion<const T>{}; !region.empty())
+        {
+            const auto total = gain * queue.currentGain();
+            audioKernels::mixAdd(region.first .data(), output.data(),                       region.first .size(), total);
+            audioKernels::mixAdd(region.second.data(), output.data() + region.first.size(), region.second.size(), total);
+            done = direct = region.size() / channelNum;
+            queue.consume(done);
+        }
+        else done = queue.read(block);
+
+        if (done < frames) queue.conceal(block.subspan(done * channelNum));
+        audioKernels::mixAdd(block.data() + direct * channelNum, output.data() + direct * channelNum, block.size() - direct * channelNum, gain);
+    }
+    if constexpr (std::same_as<T, float>) if (clipping.load(std::memory_order_relaxed)) audioKernels::softClip(output.data(), output.size());
+}
+#pragma endregion
+
+#pragma region Public APIs
+template<audioType T, typename... queuePolicies>
+std::size_t audioMixer<T, queuePolicies...>::addInput(audioQueue<T, queuePolicies...>& queue, const float gain)
+{
+    // Setup thread, the input is published to the audio callback by the release store of the count.
+    const auto index = inputNum.load(std::memory_order_relaxed);
+    if (index == maxMixInputs)
+    {
+        std::print("Mixer error : at most {} inputs can be mixed, input not added.\n", maxMixInputs);
+        return maxMixInputs;
+    }
+    inputs[index].queue = &queue;
+    inputs[index].gain .store(gain,  std::memory_order_relaxed);
+    inputs[index].muted.store(false, std::memory_order_relaxed);
+    inputNum.store(index + 1, std::memory_order_release);
+
+    return index;
+}
+
+template<audioType T, typename... queuePolicies>
+void audioMixer<T, queuePolicies...>::mix(std::span<T> output)
+{
+    // Real-time safe : the output is cleared then every input is accumulated, in blocks of at most maxFrames frames.
+    std::fill(output.begin(), output.end(), T{});
+    const auto blockSize = blockFrames * channelNum;
+    for (std::size_t offset = 0; offset < output.size(); offset += blockSize)
+        mixBlock(output.subspan(offset, std::min(blockSize, output.size() - offset)));
+}
+#pragma endregion
+
+#endif// audioMixer_H
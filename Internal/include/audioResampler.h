@@ -0,0 +1,437 @@
+#ifndef audioResampler_H
+#define audioResampler_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <numeric>
+#include <print>
+#include <span>
+#include <vector>
+
+#include "audioKernels.h"
+#include "samplerate.h"
+
+/**
+ * @brief Resampler quality tiers, from the most expensive to the cheapest.
+ *
+ * The first five map to the libsamplerate converters, native is the cheapest low-latency setting.
+ * When the conversion ratio reduces to a small fraction, the sinc tiers and native run on the built-in
+ * polyphase resampler instead, with a filter length that follows the tier.
+ * Otherwise native falls back to a linear interpolator with a single frame of latency.
+ */
+enum class resampleQuality : std::uint8_t
+{
+    best            = SRC_SINC_BEST_QUALITY,
+    medium          = SRC_SINC_MEDIUM_QUALITY,
+    fastest         = SRC_SINC_FASTEST,
+    zeroOrderHold   = SRC_ZERO_ORDER_HOLD,
+    linear          = SRC_LINEAR,
+    native
+};
+
+/**
+ * @brief Polyphase FIR resampler for a fixed rational ratio upFactor / downFactor.
+ *
+ * A Kaiser windowed-sinc prototype is split into upFactor phases of taps coefficients, each phase stored
+ * time-reversed so that an output sample is one contiguous SIMD dot product against the input history.
+ * The history is kept planar (one run per channel) so interleaved input is only de-interleaved once.
+ */
+class polyphaseResampler
+{
+    private : //Class members
+                std::size_t  upFactor;
+                std::size_t  downFactor;
+                std::size_t  taps;
+                std::size_t  channelNum;
+         std::vector<float>  coefficients;
+
+         std::vector<float>  history;
+                std::size_t  historyStride;
+                std::size_t  historyFrames;
+                std::size_t  reservedFrames;
+              std::uint64_t  position;
+
+    public : //Public member functions
+                             polyphaseResampler ();
+
+                       void  configure          (const  std:: size_t    up,
+                                                 const  std:: size_t    down,
+                                                 const  std:: size_t    tapsPerPhase,
+                                                 const         double   rolloff,
+                                                 const         double   beta,
+                                                 const  std:: size_t    channels);
+                std::size_t  process            (      std::span<const float> input,
+                                                       std::vector<float>    &output);
+                       void  reset              ();
+                       void  reserve            (const  std:: size_t    frames);
+
+    inline             bool  matches            (const  std:: size_t    up,
+                                                 const  std:: size_t    down,
+                                                 const  std:: size_t    tapsPerPhase,
+                                                 const  std:: size_t    channels) const
+                                                { return up == upFactor && down == downFactor && tapsPerPhase == taps && channels == channelNum; }
+
+    private : //Private member functions
+      static         double  besselI0           (const         double   x);
+                       void  growHistory        (const  std:: size_t    newStride);
+};
+
+/**
+ * @brief Streaming resampler owned by an audioQueue.
+ *
+ * The converter state lives as long as the object, so the filter history carries over from one block to the next
+ * and the setup cost is only paid when the channel count, the rates or the quality change. Output goes to a buffer
+ * that is kept between calls and only grows, so the steady state performs no allocation.
+ * The quality can be changed from any thread, it is applied by the next process call.
+ */
+class audioResampler
+{
+    private : //Class members
+                  SRC_STATE *state;
+                std::size_t  channelNum;
+                std::size_t  inputRate;
+                std::size_t  outputRate;
+                     double  ratio;
+                     double  correction;
+                       bool  variableRatio;
+         std::vector<float>  output;
+            resampleQuality  quality;
+std::atomic<resampleQuality> requestedQuality;
+
+                       bool  usePolyphase;
+         polyphaseResampler  polyphase;
+
+                     double  nativePosition;
+         std::vector<float>  nativeHistory;
+
+    public : //Public member functions
+                             audioResampler     ();
+                             audioResampler     (const audioResampler&) = delete;
+             audioResampler& operator=          (const audioResampler&) = delete;
+                            ~audioResampler     ();
+
+     std::span<const float>  process            (      std::span<const float> input,
+                                                 const  std:: size_t    channels,
+                                                 const  std:: size_t    sourceRate,
+                                                 const  std:: size_t    targetRate);
+                       void  reset              ();
+                       void  reserve            (const  std:: size_t    inputFrames,
+                                                 const  std:: size_t    channels,
+                                                 const         double   maxRatio);
+
+    inline             void  setQuality         (const resampleQuality  newQuality){ requestedQuality.store(newQuality, std::memory_order_relaxed); }
+    inline  resampleQuality  currentQuality     () const { return requestedQuality.load(std::memory_order_relaxed); }
+    inline             bool  isPolyphase        () const { return usePolyphase; }
+    inline             void  setVariableRatio   (const          bool    enable){ variableRatio = enable; }
+    inline             void  setCorrection      (const        double    factor){ correction = factor; }
+
+    private : //Private member functions
+                       bool  prepareState       (const  std:: size_t    channels,
+                                                 const  std:: size_t    sourceRate,
+                                                 const  std:: size_t    targetRate);
+                std::size_t  processNative      (      std::span<const float> input,
+                                                 const  std:: size_t    channels);
+};
+
+#pragma region Constructors
+inline polyphaseResampler::polyphaseResampler()
+    :   upFactor(0), downFactor(0), taps(0), channelNum(0), historyStride(0), historyFrames(0), reservedFrames(0), position(0) {}
+
+inline audioResampler::audioResampler()
+    :   state(nullptr), channelNum(0), inputRate(0), outputRate(0), ratio(1.0), correction(1.0), variableRatio(false), quality(resampleQuality::best),
+        requestedQuality(resampleQuality::best), usePolyphase(false), nativePosition(0.0) {}
+
+inline audioResampler::~audioResampler() { if (state) src_delete(state); }
+#pragma endregion
+
+#pragma region Polyphase resampler
+inline double polyphaseResampler::besselI0(const double x)
+{
+    // Power series of the modified Bessel function of the first kind, order 0.
+    double sum  = 1.0;
+    double term = 1.0;
+    for (auto k = 1; term > sum * 1e-12; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum  += term;
+    }
+    return sum;
+}
+
+inline void polyphaseResampler::configure(const std::size_t up, const std::size_t down, const std::size_t tapsPerPhase, const double rolloff, const double beta, const std::size_t channels)
+{
+    if (matches(up, down, tapsPerPhase, channels)) return;
+
+    upFactor   = up;
+    downFactor = down;
+    taps       = tapsPerPhase;
+    channelNum = channels;
+
+    // Prototype low-pass at the upsampled rate, cut below the lower of the two Nyquist frequencies.
+    const auto length = upFactor * taps;
+    const auto cutoff = rolloff / static_cast<double>(std::max(upFactor, downFactor));
+    const auto centre = static_cast<double>(length - 1) / 2.0;
+    const auto norm   = besselI0(beta);
+
+    coefficients.assign(length, 0.0f);
+    std::vector<double> phaseTaps(taps);
+    for (std::size_t phase = 0; phase < upFactor; phase++)
+    {
+        double phaseSum = 0.0;
+        for (std::size_t k = 0; k < taps; k++)
+        {
+            const auto n      = phase + k * upFactor;
+            const auto t      = static_cast<double>(n) - centre;
+            const auto x      = std::numbers::pi * cutoff * t;
+            const auto sinc   = t == 0.0 ? 1.0 : std::sin(x) / x;
+            const auto edge   = length > 1 ? 2.0 * static_cast<double>(n) / static_cast<double>(length - 1) - 1.0 : 0.0;
+            const auto window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - edge * edge))) / norm;
+
+            phaseTaps[k] = sinc * window;
+            phaseSum    += phaseTaps[k];
+        }
+        // Each phase is normalised to unity DC gain, then stored time-reversed.
+        for (std::size_t k = 0; k < taps; k++)
+            coefficients[phase * taps + (taps - 1 - k)] = static_cast<float>(phaseTaps[k] / phaseSum);
+    }
+    reset();
+}
+
+inline void polyphaseResampler::reset()
+{
+    // Start with taps - 1 frames of silence so the first output already has a full history.
+    historyStride = std::max({ historyStride, taps * 4, taps + reservedFrames });
+    history.assign(historyStride * channelNum, 0.0f);
+    historyFrames = taps ? taps - 1 : 0;
+    position      = static_cast<std::uint64_t>(historyFrames) * upFactor;
+}
+
+inline std::size_t polyphaseResampler::process(std::span<const float> input, std::vector<float>& output)
+{
+    if (!channelNum || !taps) return 0;
+    const auto inputFrames = input.size() / channelNum;
+
+    // Grow the planar history when the block does not fit, this only happens on the first large blocks.
+    if (historyFrames + inputFrames > historyStride) growHistory((historyFrames + inputFrames) * 2);
+
+    for (std::size_t c = 0; c < channelNum; c++)
+    {
+        auto channel = history.data() + c * historyStride + historyFrames;
+        for (std::size_t f = 0; f < inputFrames; f++) channel[f] = input[f * channelNum + c];
+    }
+    historyFrames += inputFrames;
+
+    std::size_t genFrames = 0;
+    for (; position / upFactor < historyFrames; position += downFactor, genFrames++)
+    {
+        if ((genFrames + 1) * channelNum > output.size()) output.resize(output.size() * 2 + channelNum);
+
+        const auto base  = static_cast<std::size_t>(position / upFactor);
+        const auto phase = static_cast<std::size_t>(position % upFactor);
+        const auto coeff = coefficients.data() + phase * taps;
+        const auto out   = output.data() + genFrames * channelNum;
+
+        for (std::size_t c = 0; c < channelNum; c++)
+            out[c] = audioKernels::dotProduct(history.data() + c * historyStride + base + 1 - taps, coeff, taps);
+    }
+
+    // Drop the frames no future output can reach, keeping the last taps - 1 of them as history.
+    const auto firstNeeded = static_cast<std::size_t>(position / upFactor) + 1 - taps;
+    const auto dropped     = std::min(firstNeeded, historyFrames);
+    if (dropped)
+    {
+        for (std::size_t c = 0; c < channelNum; c++)
+        {
+            auto channel = history.data() + c * historyStride;
+            std::memmove(channel, channel + dropped, (historyFrames - dropped) * sizeof(float));
+        }
+        historyFrames -= dropped;
+        position      -= static_cast<std::uint64_t>(dropped) * upFactor;
+    }
+
+    return genFrames;
+}
+
+inline void polyphaseResampler::reserve(const std::size_t frames)
+{
+    // Blocks of up to frames input frames then fit in the history without reallocating, reset applies it on configuration.
+    reservedFrames = std::max(reservedFrames, frames);
+    if (channelNum && taps + frames > historyStride) growHistory(taps + frames);
+}
+
+inline void polyphaseResampler::growHistory(const std::size_t newStride)
+{
+    std::vector<float> newHistory(newStride * channelNum);
+    for (std::size_t c = 0; c < channelNum; c++)
+        std::copy_n(history.data() + c * historyStride, historyFrames, newHistory.data() + c * newStride);
+    history       = std::move(newHistory);
+    historyStride = newStride;
+}
+#pragma endregion
+
+#pragma region Private member functions
+inline bool audioResampler::prepareState(const std::size_t channels, const std::size_t sourceRate, const std::size_t targetRate)
+{
+    // Filter length, pass band edge and Kaiser beta of the polyphase filter for each tier.
+    struct polyphaseTier { std::size_t taps; double rolloff; double beta; };
+    constexpr polyphaseTier   bestTier    { 64, 0.94, 9.0 };
+    constexpr polyphaseTier   mediumTier  { 32, 0.91, 7.5 };
+    constexpr polyphaseTier   fastestTier { 16, 0.86, 6.0 };
+    constexpr polyphaseTier   nativeTier  {  8, 0.80, 5.0 };
+    constexpr std::size_t     maxPhases   = 1024;
+
+    const auto newQuality = requestedQuality.load(std::memory_order_relaxed);
+    const auto divisor    = std::gcd(sourceRate, targetRate);
+    const auto up         = targetRate / divisor;
+    const auto down       = sourceRate / divisor;
+
+    const auto rational   = up <= maxPhases && down <= maxPhases;
+    const auto tier       = newQuality == resampleQuality::best    ? bestTier
+                          : newQuality == resampleQuality::medium  ? mediumTier
+                          : newQuality == resampleQuality::fastest ? fastestTier : nativeTier;
+    // A drifting ratio cannot be expressed by a fixed up/down pair, it goes to libsamplerate or the native interpolator.
+    const auto wasPolyphase = usePolyphase;
+    usePolyphase = rational && !variableRatio && newQuality != resampleQuality::zeroOrderHold && newQuality != resampleQuality::linear;
+    ratio        = static_cast<double>(targetRate) / static_cast<double>(sourceRate) * correction;
+
+    // The engine taken over after a switch holds no history or a stale one, it restarts from silence.
+    const auto sameFormat = channels == channelNum && newQuality == quality;
+    const auto isReady    = sameFormat && usePolyphase == wasPolyphase;
+    if (usePolyphase)
+    {
+        polyphase.configure(up, down, tier.taps, tier.rolloff, tier.beta, channels);
+        if (!isReady) polyphase.reset();
+    }
+    else if (newQuality == resampleQuality::native)
+    {
+        if (!isReady)
+        {
+            nativePosition = 0.0;
+            nativeHistory.assign(channels, 0.0f);
+        }
+    }
+    else if (!state || !sameFormat)
+    {
+        if (state) src_delete(state);
+
+        int error = 0;
+        state = src_new(static_cast<int>(newQuality), static_cast<int>(channels), &error);
+        if (!state)
+        {
+            std::print("Resampler error : {}.\n", src_strerror(error));
+            return false;
+        }
+        src_set_ratio(state, ratio);
+    }
+    else if (!isReady)
+    {
+        src_reset(state);
+        src_set_ratio(state, ratio);
+    }
+    // A new rate pair is applied as a step, otherwise libsamplerate would glide to it over the block.
+    // Correction updates are left to glide, which keeps drift compensation free of clicks.
+    else if (sourceRate != inputRate || targetRate != outputRate) src_set_ratio(state, ratio);
+
+    channelNum = channels;
+    inputRate  = sourceRate;
+    outputRate = targetRate;
+    quality    = newQuality;
+
+    return true;
+}
+
+inline std::size_t audioResampler::processNative(std::span<const float> input, const std::size_t channels)
+{
+    // Linear interpolation between the previous and the current input frame, the last frame of each block
+    // is kept as history so the output is continuous across blocks.
+    const auto inputFrames = input.size() / channels;
+    const auto step        = 1.0 / ratio;
+
+    std::size_t genFrames = 0;
+    for (; nativePosition < static_cast<double>(inputFrames); nativePosition += step, genFrames++)
+    {
+        if ((genFrames + 1) * channels > output.size()) output.resize(output.size() * 2 + channels);
+
+        const auto index    = static_cast<std::size_t>(nativePosition);
+        const auto fraction = static_cast<float>(nativePosition - static_cast<double>(index));
+        const auto previous = index ? input.data() + (index - 1) * channels : nativeHistory.data();
+        const auto current  = input.data() + index * channels;
+        const auto out      = output.data() + genFrames * channels;
+
+        for (std::size_t c = 0; c < channels; c++) out[c] = previous[c] + (current[c] - previous[c]) * fraction;
+    }
+    if (inputFrames)
+    {
+        std::copy_n(input.data() + (inputFrames - 1) * channels, channels, nativeHistory.data());
+        nativePosition -= static_cast<double>(inputFrames);
+    }
+
+    return genFrames;
+}
+#pragma endregion
+
+#pragma region Public APIs
+inline std::span<const float> audioResampler::process(std::span<const float> input, const std::size_t channels, const std::size_t sourceRate, const std::size_t targetRate)
+{
+    if (!channels || !sourceRate || !targetRate || !prepareState(channels, sourceRate, targetRate)) return {};
+
+    const auto inputFrames = input.size() / channels;
+    const auto expected    = static_cast<std::size_t>(std::ceil(static_cast<double>(inputFrames) * ratio)) + 1;
+    if (output.size() < expected * channels) output.resize(expected * channels);
+
+    if (usePolyphase)                       return { output.data(), polyphase.process(input, output) * channels };
+    if (quality == resampleQuality::native) return { output.data(), processNative(input, channels)   * channels };
+
+    std::size_t usedFrames = 0;
+    std::size_t genFrames  = 0;
+    while (usedFrames < inputFrames)
+    {
+        // The converter may keep part of the input in its history or stop when the output is full,
+        // keep feeding it until the whole block has been taken.
+        if (genFrames * channels == output.size()) output.resize(output.size() * 2);
+
+        SRC_DATA srcData;
+        srcData.end_of_input    = 0;
+        srcData.data_in         = input .data() + usedFrames * channels;
+        srcData.data_out        = output.data() + genFrames  * channels;
+        srcData.input_frames    = static_cast<long>(inputFrames - usedFrames);
+        srcData.output_frames   = static_cast<long>(output.size() / channels - genFrames);
+        srcData.src_ratio       = ratio;
+
+        if (const auto error = src_process(state, &srcData))
+        {
+            std::print("Resampler error : {}.\n", src_strerror(error));
+            break;
+        }
+        usedFrames += srcData.input_frames_used;
+        genFrames  += srcData.output_frames_gen;
+
+        if (!srcData.input_frames_used && !srcData.output_frames_gen) break;
+    }
+
+    return { output.data(), genFrames * channels };
+}
+
+inline void audioResampler::reserve(const std::size_t inputFrames, const std::size_t channels, const double maxRatio)
+{
+    // Size the output and the polyphase history for the largest expected block up front,
+    // so that the first blocks of a stream do not grow them on the audio path.
+    const auto expected = static_cast<std::size_t>(std::ceil(static_cast<double>(inputFrames) * maxRatio)) + 2;
+    if (output.size() < expected * channels) output.resize(expected * channels);
+    polyphase.reserve(inputFrames);
+}
+
+inline void audioResampler::reset()
+{
+    if (state) src_reset(state);
+    polyphase.reset();
+    nativePosition = 0.0;
+    std::fill(nativeHistory.begin(), nativeHistory.end(), 0.0f);
+}
+#pragma endregion
+
+#endif// audioResampler_H
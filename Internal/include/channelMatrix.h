@@ -0,0 +1,176 @@
+#ifndef channelMatrix_H
+#define channelMatrix_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <print>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "audioKernels.h"
+
+/**
+ * @brief Up/down-mix engine applying an outputs x inputs gain matrix to interleaved frames.
+ *
+ * The matrix is analysed once when it is set and the cheapest kernel able to apply it is kept :
+ * mono to stereo, stereo to mono, 5.1 and 7.1 to stereo, a plain channel subset, any count to stereo,
+ * or the generic row by row product.
+ */
+class channelMatrix
+{
+    private : //Class members
+    enum class mixKernel { identity, subset, monoToStereo, stereoToMono, surround51ToStereo, surround71ToStereo, toStereo, generic };
+
+                std::size_t  inputNum;
+                std::size_t  outputNum;
+         std::vector<float>  gains;
+                  mixKernel  kernel;
+
+    public : //Public member functions
+                             channelMatrix      ();
+
+                       void  setLayout          (const  std:: size_t    inputs,
+                                                 const  std:: size_t    outputs);
+                       bool  setGains           (      std::span<const float> matrix,
+                                                 const  std:: size_t    inputs,
+                                                 const  std:: size_t    outputs);
+    template<typename T>
+                       void  process            (      std::span<const T>   input,
+                                                       std::span<T>         output) const;
+
+    inline      std::size_t  inputs             () const { return inputNum; }
+    inline      std::size_t  outputs            () const { return outputNum; }
+    inline             bool  matches            (const  std:: size_t    inputs,
+                                                 const  std:: size_t    outputs) const { return inputs == inputNum && outputs == outputNum; }
+
+    private : //Private member functions
+                       void  selectKernel       ();
+    inline     const float*  row                (const  std:: size_t    output) const { return gains.data() + output * inputNum; }
+};
+
+#pragma region Constructors
+inline channelMatrix::channelMatrix() : inputNum(0), outputNum(0), kernel(mixKernel::identity) {}
+#pragma endregion
+
+#pragma region Private member functions
+inline void channelMatrix::selectKernel()
+{
+    const auto isSubset = [this]
+    {
+        for (std::size_t o = 0; o < outputNum; o++)
+            for (std::size_t i = 0; i < inputNum; i++)
+                if (row(o)[i] != (i == o ? 1.0f : 0.0f)) return false;
+        return true;
+    };
+
+         if (outputNum <= inputNum && isSubset()) kernel = inputNum == outputNum ? mixKernel::identity : mixKernel::subset;
+    else if (inputNum == 1 && outputNum == 2)     kernel = mixKernel::monoToStereo;
+    else if (inputNum == 2 && outputNum == 1)     kernel = mixKernel::stereoToMono;
+    else if (inputNum == 6 && outputNum == 2)     kernel = mixKernel::surround51ToStereo;
+    else if (inputNum == 8 && outputNum == 2)     kernel = mixKernel::surround71ToStereo;
+    else if (outputNum == 2)                      kernel = mixKernel::toStereo;
+    else                                          kernel = mixKernel::generic;
+}
+#pragma endregion
+
+#pragma region Public APIs
+inline void channelMatrix::setLayout(const std::size_t inputs, const std::size_t outputs)
+{
+    // Default matrices, channel orders follow WAVE : L R C LFE Ls Rs for 5.1, L R C LFE Lb Rb Ls Rs for 7.1.
+    // The LFE is dropped from stereo down-mixes, centre and surrounds are attenuated by 3 dB.
+    constexpr auto minus3dB = 0.70710678f;
+
+    inputNum  = inputs;
+    outputNum = outputs;
+    gains.assign(inputs * outputs, 0.0f);
+    auto gain = [this](const std::size_t o, const std::size_t i) -> float& { return gains[o * inputNum + i]; };
+
+    if (inputs == 1 && outputs == 2)
+    {
+        gain(0, 0) = 1.0f;
+        gain(1, 0) = 1.0f;
+    }
+    else if (inputs == 2 && outputs == 1)
+    {
+        gain(0, 0) = 0.5f;
+        gain(0, 1) = 0.5f;
+    }
+    else if ((inputs == 6 || inputs == 8) && outputs == 2)
+    {
+        gain(0, 0) = 1.0f;      gain(1, 1) = 1.0f;
+        gain(0, 2) = minus3dB;  gain(1, 2) = minus3dB;
+        gain(0, 4) = minus3dB;  gain(1, 5) = minus3dB;
+        if (inputs == 8)
+        {
+            gain(0, 6) = minus3dB;
+            gain(1, 7) = minus3dB;
+        }
+    }
+    else for (std::size_t c = 0; c < std::min(inputs, outputs); c++) gain(c, c) = 1.0f;
+
+    selectKernel();
+}
+
+inline bool channelMatrix::setGains(std::span<const float> matrix, const std::size_t inputs, const std::size_t outputs)
+{
+    if (matrix.size() != inputs * outputs)
+    {
+        std::print("Channel matrix error : {} gains given for a {}x{} matrix.\n", matrix.size(), outputs, inputs);
+        return false;
+    }
+    inputNum  = inputs;
+    outputNum = outputs;
+    gains.assign(matrix.begin(), matrix.end());
+    selectKernel();
+
+    return true;
+}
+
+template<typename T>
+void channelMatrix::process(std::span<const T> input, std::span<T> output) const
+{
+    if (!inputNum || !outputNum) return;
+
+    const auto frames = std::min(input.size() / inputNum, output.size() / outputNum);
+    const auto in     = input .data();
+    const auto out    = output.data();
+
+    if constexpr (std::same_as<T, float>)
+    {
+        switch (kernel)
+        {
+            case mixKernel::identity           : std::copy_n(in, frames * inputNum, out);                                       return;
+            case mixKernel::subset             : audioKernels::channelSubset   (in, out, frames, inputNum, outputNum);          return;
+            case mixKernel::monoToStereo       : audioKernels::monoToStereo    (in, out, frames, row(0)[0], row(1)[0]);         return;
+            case mixKernel::stereoToMono       : audioKernels::stereoToMono    (in, out, frames, row(0)[0], row(0)[1]);         return;
+            case mixKernel::surround51ToStereo : audioKernels::mixToStereo<6>  (in, out, frames, row(0), row(1));               return;
+            case mixKernel::surround71ToStereo : audioKernels::mixToStereo<8>  (in, out, frames, row(0), row(1));               return;
+            case mixKernel::toStereo           :
+                for (std::size_t f = 0; f < frames; f++)
+                {
+                    out[f * 2]     = audioKernels::dotProduct(in + f * inputNum, row(0), inputNum);
+                    out[f * 2 + 1] = audioKernels::dotProduct(in + f * inputNum, row(1), inputNum);
+                }
+                return;
+            case mixKernel::generic            : break;
+        }
+    }
+
+    // Generic path, also used by the other sample types. int16 is mixed in float, wider samples in double,
+    // integer results are saturated back.
+    using accumulator = std::conditional_t<std::same_as<T, short> || std::same_as<T, float>, float, double>;
+    for (std::size_t f = 0; f < frames; f++)
+    {
+        for (std::size_t o = 0; o < outputNum; o++)
+        {
+            accumulator sum = 0;
+            for (std::size_t i = 0; i < inputNum; i++) sum += toNormalized(in[f * inputNum + i]) * row(o)[i];
+            out[f * outputNum + o] = fromNormalized<T>(sum);
+        }
+    }
+}
+#pragma endregion
+
+#endif// channelMatrix_H
@@ -0,0 +1,110 @@
+#ifndef framePool_H
+#define framePool_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "queueStorage.h"
+
+/**
+ * @brief Fixed-size block pool with a lock-free free list.
+ *
+ * All blocks are allocated once by the constructor and aligned on 64 bytes, acquire and release never touch
+ * the heap and may be called from any thread. The free list head packs the block index with a tag
+ * incremented on every update so that a concurrent pop and push of the same block cannot be confused (ABA).
+ */
+template<typename T>
+class framePool
+{
+    private : //Class members
+    static constexpr std::size_t   alignment = 64;
+    static constexpr std::uint32_t endOfList = UINT32_MAX;
+
+                std::size_t  blockLength;
+                std::size_t  blockStride;
+                std::size_t  blockCount;
+std::vector<T, alignedAllocator<T, alignment>>  storage;
+                         T*  firstBlock;
+std::unique_ptr<std::atomic<std::uint32_t>[]> next;
+    alignas(alignment) std::atomic<std::uint64_t> head;
+
+    public : //Public member functions
+                             framePool          (const  std:: size_t    length,
+                                                 const  std:: size_t    count);
+                             framePool          (const framePool&) = delete;
+                  framePool& operator=          (const framePool&) = delete;
+
+               std::span<T>  acquire            ();
+                       void  release            (      std::span<T>         block);
+
+    inline      std::size_t  blockSize          () const { return blockLength; }
+    inline      std::size_t  blocks             () const { return blockCount; }
+
+    private : //Private member functions
+    static constexpr std::uint64_t pack         (const std::uint32_t    index,
+                                                 const std::uint32_t    tag) { return static_cast<std::uint64_t>(tag) << 32 | index; }
+    static constexpr std::uint32_t indexOf      (const std::uint64_t    value) { return static_cast<std::uint32_t>(value); }
+    static constexpr std::uint32_t tagOf        (const std::uint64_t    value) { return static_cast<std::uint32_t>(value >> 32); }
+    static constexpr std::size_t   strideFor    (const std::size_t      length);
+};
+
+#pragma region Constructors
+template<typename T>
+framePool<T>::framePool(const std::size_t length, const std::size_t count)
+    :   blockLength(length), blockStride(strideFor(length)),
+        blockCount(std::min<std::size_t>(count, endOfList)), next(std::make_unique<std::atomic<std::uint32_t>[]>(blockCount)), head(pack(endOfList, 0))
+{
+    // One aligned allocation for every block, the stride keeps each following block on the alignment.
+    storage.resize(blockStride * blockCount);
+    firstBlock = storage.data();
+
+    for (std::size_t i = 0; i < blockCount; i++) next[i].store(i + 1 < blockCount ? static_cast<std::uint32_t>(i + 1) : endOfList, std::memory_order_relaxed);
+    if (blockCount) head.store(pack(0, 0), std::memory_order_release);
+}
+#pragma endregion
+
+#pragma region Private member functions
+template<typename T>
+constexpr std::size_t framePool<T>::strideFor(const std::size_t length)
+{
+    // Whole elements spanning a whole number of alignments : with a size that does not divide the alignment
+    // (a 24 or 40 byte struct), rounding the bytes up alone would leave the next block short of the boundary.
+    const auto unit = std::lcm(alignment, sizeof(T)) / sizeof(T);
+    return std::max<std::size_t>((length + unit - 1) / unit, 1) * unit;
+}
+#pragma endregion
+
+#pragma region Public APIs
+template<typename T>
+std::span<T> framePool<T>::acquire()
+{
+    // Pop the first free block, an empty span means the pool is exhausted.
+    auto current = head.load(std::memory_order_acquire);
+    while (indexOf(current) != endOfList)
+    {
+        const auto index   = indexOf(current);
+        const auto updated = pack(next[index].load(std::memory_order_relaxed), tagOf(current) + 1);
+        if (head.compare_exchange_weak(current, updated, std::memory_order_acquire, std::memory_order_acquire))
+            return { firstBlock + index * blockStride, blockLength };
+    }
+    return {};
+}
+
+template<typename T>
+void framePool<T>::release(std::span<T> block)
+{
+    if (block.empty()) return;
+
+    const auto index   = static_cast<std::uint32_t>((block.data() - firstBlock) / blockStride);
+    auto       current = head.load(std::memory_order_relaxed);
+    do next[index].store(indexOf(current), std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(current, pack(index, tagOf(current) + 1), std::memory_order_release, std::memory_order_relaxed));
+}
+#pragma endregion
+
+#endif// framePool_H
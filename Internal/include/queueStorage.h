@@ -0,0 +1,92 @@
+#ifndef queueStorage_H
+#define queueStorage_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * @brief Huge page mappings of hugePageAllocator, implemented in audioFrame.cpp so that the system headers stay out of this one.
+ *
+ * mapHugePages returns a block of at least bytes bytes on huge pages, or on regular pages when the system has none
+ * reserved (or the process lacks the large page privilege on Windows), nullptr when both fail.
+ * unmapHugePages takes the same size back.
+ */
+void* mapHugePages  (const std::size_t bytes);
+void  unmapHugePages(void* pointer, const std::size_t bytes);
+
+/**
+ * @brief Allocator returning storage aligned on a fixed boundary, so that a ring starts on its own cache line.
+ */
+template<typename T, std::size_t alignment>
+struct alignedAllocator
+{
+    using value_type = T;
+    template<typename U> struct rebind { using other = alignedAllocator<U, alignment>; };
+
+    constexpr alignedAllocator() noexcept = default;
+    template<typename U>
+    constexpr alignedAllocator(const alignedAllocator<U, alignment>&) noexcept {}
+
+    T*   allocate  (const std::size_t count)                   { return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* pointer, const std::size_t)   noexcept  { ::operator delete(pointer, std::align_val_t(alignment)); }
+
+    template<typename U>
+    constexpr bool operator==(const alignedAllocator<U, alignment>&) const noexcept { return true; }
+};
+
+/**
+ * @brief Allocator mapping large blocks on huge pages, which removes most TLB misses when a long ring is walked.
+ *
+ * Blocks smaller than one huge page are not worth a mapping and come from the aligned heap. The choice only
+ * depends on the size so that deallocate finds the matching release path.
+ */
+template<typename T>
+struct hugePageAllocator
+{
+    using value_type = T;
+    static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    constexpr hugePageAllocator() noexcept = default;
+    template<typename U>
+    constexpr hugePageAllocator(const hugePageAllocator<U>&) noexcept {}
+
+    T* allocate(const std::size_t count)
+    {
+        if (count * sizeof(T) < hugePageSize) return alignedAllocator<T, 64>{}.allocate(count);
+        if (const auto pointer = mapHugePages(count * sizeof(T))) return static_cast<T*>(pointer);
+        throw std::bad_alloc();
+    }
+
+    void deallocate(T* pointer, const std::size_t count) noexcept
+    {
+        if (count * sizeof(T) < hugePageSize) alignedAllocator<T, 64>{}.deallocate(pointer, count);
+        else                                  unmapHugePages(pointer, count * sizeof(T));
+    }
+
+    template<typename U>
+    constexpr bool operator==(const hugePageAllocator<U>&) const noexcept { return true; }
+};
+
+/**
+ * @brief Storage policies, the container holding the ring samples of an audioQueue.
+ *
+ * heapStorage is a plain std::vector, alignedStorage starts the ring on a cache line, hugePageStorage maps long
+ * rings on huge pages. Every buffer is value-initialized to silence.
+ */
+struct heapStorage
+{
+    template<typename T> using buffer = std::vector<T>;
+};
+
+struct alignedStorage
+{
+    template<typename T> using buffer = std::vector<T, alignedAllocator<T, 64>>;
+};
+
+struct hugePageStorage
+{
+    template<typename T> using buffer = std::vector<T, hugePageAllocator<T>>;
+};
+
+#endif// queueStorage_H
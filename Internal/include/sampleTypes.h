@@ -0,0 +1,66 @@
+#ifndef sampleTypes_H
+#define sampleTypes_H
+
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+
+/**
+ * @brief Packed little-endian 24-bit PCM sample, 3 bytes in memory.
+ *
+ * Converts to and from std::int32_t, the value is sign-extended on the way out and the top byte is dropped on the way in.
+ */
+struct int24
+{
+    std::uint8_t bytes[3];
+
+                        int24() = default;
+    constexpr           int24(const std::int32_t value)
+                            : bytes{ static_cast<std::uint8_t>(value), static_cast<std::uint8_t>(value >> 8), static_cast<std::uint8_t>(value >> 16) } {}
+    constexpr operator  std::int32_t() const
+    {
+        const auto value = static_cast<std::int32_t>(bytes[0] | bytes[1] << 8 | bytes[2] << 16);
+        return value & 0x800000 ? value - 0x1000000 : value;
+    }
+};
+static_assert(sizeof(int24) == 3, "int24 must be packed.");
+
+/**
+ * @brief Full scale of a sample type : integer samples map [-fullScale, fullScale) to [-1, 1), floating samples are already normalized.
+ */
+template<typename T>
+inline constexpr double fullScale()
+{
+         if constexpr (std::same_as<T, short>)        return 32768.0;
+    else if constexpr (std::same_as<T, int24>)        return 8388608.0;
+    else if constexpr (std::same_as<T, std::int32_t>) return 2147483648.0;
+    else                                              return 1.0;
+}
+
+template<typename T>
+inline constexpr bool isIntegerSample = !std::floating_point<T>;
+
+/**
+ * @brief Scalar conversions through a normalized double, the reference for every conversion kernel.
+ * Integer results are rounded to nearest and saturated.
+ */
+template<typename T>
+inline double toNormalized(const T sample)
+{
+    if constexpr (isIntegerSample<T>) return static_cast<double>(static_cast<std::int32_t>(sample)) / fullScale<T>();
+    else                              return static_cast<double>(sample);
+}
+
+template<typename T>
+inline T fromNormalized(const double value)
+{
+    if constexpr (isIntegerSample<T>)
+    {
+        const auto scaled = std::clamp(std::nearbyint(value * fullScale<T>()), -fullScale<T>(), fullScale<T>() - 1.0);
+        return static_cast<T>(static_cast<std::int32_t>(scaled));
+    }
+    else return static_cast<T>(value);
+}
+
+#endif// sampleTypes_H
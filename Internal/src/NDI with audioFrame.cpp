@@ -2,6 +2,8 @@
 #include "Processing.NDI.Lib.h" 
 #include "portaudio.h"
 #include "audioFrame.h"
+#include "audioMixer.h"
+#include "framePool.h"
 #include <print>
 
 /**
@@ -11,6 +13,7 @@
  */
 #pragma region Signal handler
 static std::atomic<bool> exit_loop(false);
+static std::atomic<bool> output_stopped(false);	// Set once the PortAudio stream is closed, the queue has no reader left.
 static void sigIntHandler(int) {exit_loop = true;}
 #pragma endregion
 
@@ -21,11 +24,28 @@ static void sigIntHandler(int) {exit_loop = true;}
  */
 #pragma region Global definition
 constexpr auto SAMPLE_RATE					= 48000;
+constexpr auto OUTPUT_CHANNELS				= 2;
 constexpr auto PA_BUFFER_SIZE				= 128;
 constexpr auto NDI_TIMEOUT					= 1000;
-constexpr auto QUEUE_SIZE_MULTIPLIER		= 200;
-audioQueue<float> NDIdata(0);
-audioQueue<float> MicroInput(0);
+constexpr auto TARGET_LATENCY				= std::chrono::milliseconds(20);
+constexpr auto MAX_LATENCY					= std::chrono::milliseconds(100);
+constexpr auto LATENCY_HEADROOM				= std::chrono::milliseconds(10);
+constexpr auto MIN_TARGET_LATENCY			= std::chrono::milliseconds(5);
+constexpr auto MAX_TARGET_LATENCY			= std::chrono::milliseconds(80);
+constexpr auto NDI_BLOCK_SAMPLES			= 1024 * 16;
+constexpr auto NDI_POOL_BLOCKS				= 2;
+constexpr auto ZERO_COPY_INPUT				= false;	// Sources must already be in the output format.
+constexpr auto INT16_PIPELINE				= false;	// Queue, mix and play int16 samples, half the memory of float.
+constexpr auto NDI_REFERENCE_LEVEL			= 0;		// dB above +4 dBU at int16 full scale, 0 keeps the float levels.
+using sampleType = std::conditional_t<INT16_PIPELINE, short, float>;
+constexpr PaSampleFormat PA_SAMPLE_FORMAT	= INT16_PIPELINE ? paInt16 : paFloat32;
+static_assert(!(ZERO_COPY_INPUT && INT16_PIPELINE), "Held NDI frames are float, the zero copy input needs the float pipeline.");
+
+audioQueue<sampleType> NDIdata(0);
+framePool<sampleType>  NDIPool(NDI_BLOCK_SAMPLES, NDI_POOL_BLOCKS);
+framePool<NDIlib_audio_frame_v2_t> NDIHeldFrames(1, maxHeldFrames);
+audioQueue<sampleType> MicroInput(0);
+audioMixer<sampleType> outputMixer(OUTPUT_CHANNELS, PA_BUFFER_SIZE);
 #pragma endregion
 
 /**
@@ -39,6 +59,97 @@ inline T*	NDIErrorCheck (T*	   ptr){if (!ptr){ std::print("NDI Error: No source
 inline void  PAErrorCheck (PaError err){if ( err){ std::print("PortAudio error : {}.\n", Pa_GetErrorText(err)); exit(EXIT_FAILURE);}}
 #pragma endregion
 
+/**
+ * @brief Interleave a range of a planar NDI frame into a destination span.
+ * 
+ * The range starts at sample offset and covers as many whole frames as dest can hold.
+ */
+#pragma region NDI conversion
+inline void NDIToInterleaved(const NDIlib_audio_frame_v2_t& frame, const std::size_t offset, std::span<float> dest)
+{
+	if (dest.empty()) return;
+
+	auto part		= frame;
+	part.p_data		= frame.p_data + offset;
+	part.no_samples = static_cast<int>(dest.size() / frame.no_channels);
+
+	NDIlib_audio_frame_interleaved_32f_t interleaved;
+	interleaved.p_data = dest.data();
+	NDIlib_util_audio_to_interleaved_32f_v2(&part, &interleaved);
+}
+
+inline void NDIToInterleaved(const NDIlib_audio_frame_v2_t& frame, const std::size_t offset, std::span<short> dest)
+{
+	if (dest.empty()) return;
+
+	auto part		= frame;
+	part.p_data		= frame.p_data + offset;
+	part.no_samples = static_cast<int>(dest.size() / frame.no_channels);
+
+	NDIlib_audio_frame_interleaved_16s_t interleaved;
+	interleaved.reference_level = NDI_REFERENCE_LEVEL;
+	interleaved.p_data			= dest.data();
+	NDIlib_util_audio_to_interleaved_16s_v2(&part, &interleaved);
+}
+#pragma endregion
+
+#pragma region NDI direct input
+/**
+ * @brief Planar NDI input without interleaving, float queues only : int16 queues always convert.
+ * 
+ * A held queue keeps the frame and reads it in place, a queue in the output format without drift compensation
+ * nor jitter buffer takes a plain copy of the planes. Any other frame has to be converted.
+ */
+enum class NDIInput { kept, copied, convert };
+
+template <typename T>
+inline void NDIReleaseHeld(audioQueue<T>& queue, NDIlib_recv_instance_t receiver)
+{
+	// Held frames are handed back to NDI from the NDI thread once the audio callback has played them.
+	if constexpr (std::same_as<T, float>) queue.setHeldRelease([receiver](const heldFrame<float>& frame)
+	{
+		const auto owner = static_cast<NDIlib_audio_frame_v2_t*>(frame.owner);
+		NDIlib_recv_free_audio_v2(receiver, owner);
+		NDIHeldFrames.release({ owner, 1 });
+	});
+}
+
+template <typename T>
+inline NDIInput NDIDirectInput(audioQueue<T>& queue, const NDIlib_audio_frame_v2_t& frame)
+{
+	if constexpr (!std::same_as<T, float>) return NDIInput::convert;
+	else
+	{
+		const std::size_t noSamples	= frame.no_samples;
+		const std::size_t noChannels	= frame.no_channels;
+		const std::size_t stride		= frame.channel_stride_in_bytes / sizeof(float);
+
+		if (queue.storageLayout() == sampleLayout::held)
+		{
+			// Zero copy : the frame is kept alive until the release callback. A frame the queue cannot hold is dropped.
+			const auto owner = NDIHeldFrames.acquire();
+			if (!owner.empty())
+			{
+				owner.front() = frame;
+				if (queue.hold({ frame.p_data, noSamples, noChannels, stride, static_cast<std::size_t>(frame.sample_rate), owner.data() })) return NDIInput::kept;
+				NDIHeldFrames.release(owner);
+			}
+			queue.reportDropped(noSamples);
+			return NDIInput::copied;
+		}
+		if (frame.sample_rate == SAMPLE_RATE && frame.no_channels == OUTPUT_CHANNELS && !queue.driftCompensated() && !queue.jitterBuffered())
+		{
+			// Same format as the output : apply the overflow policy as push would, then copy the planar NDI channels
+			// straight into the ring storage, no intermediate buffer.
+			const auto frames = queue.writePlanar(frame.p_data, stride, queue.makeRoom(noSamples));
+			queue.reportDropped(noSamples - frames);
+			return NDIInput::copied;
+		}
+		return NDIInput::convert;
+	}
+}
+#pragma endregion
+
 #pragma region NDI IO
 void NDIAudioTread()
 {
@@ -63,10 +174,32 @@ void NDIAudioTread()
 
 	auto pNDI_recv = NDIErrorCheck(NDIlib_recv_create_v3(&NDIRecvCreateDesc));
 	NDIlib_find_destroy(pNDIFind);
+
+	NDIReleaseHeld(NDIdata, pNDI_recv);
 	#pragma endregion
 	
 	#pragma region NDI Data capture
 	NDIlib_audio_frame_v2_t audioInput;
+
+	// Conversion, drift compensation and the jitter buffer work on interleaved samples, the frame is converted
+	// into a pooled block, in chunks when it is larger than one block. Each chunk is placed on the sender timeline
+	// by the frame timecode plus its offset.
+	const auto pushConverted = [&](const std::size_t noSamples, const std::size_t noChannels)
+	{
+		const auto block		= NDIPool.acquire();
+		const auto chunkFrames	= block.size() / noChannels;
+		const auto start		= mediaTicks(audioInput.timecode);
+		if (!chunkFrames) NDIdata.reportDropped(noSamples);
+		else for (std::size_t offset = 0; offset < noSamples; offset += chunkFrames)
+		{
+			const auto frames	= std::min(chunkFrames, noSamples - offset);
+			const auto chunk	= block.first(frames * noChannels);
+			NDIToInterleaved(audioInput, offset, chunk);
+			NDIdata.push(chunk.data(), frames, OUTPUT_CHANNELS, SAMPLE_RATE,
+						 start == untimed ? untimed : start + mediaTicks(static_cast<std::int64_t>(offset) * mediaTicks::period::den / audioInput.sample_rate));
+		}
+		NDIPool.release(block);
+	};
 	 
 	while (!exit_loop)
 	{
@@ -74,27 +207,32 @@ void NDIAudioTread()
 		auto NDI_frame_type = NDIlib_recv_capture_v2(pNDI_recv, nullptr, &audioInput, nullptr, NDI_TIMEOUT);
 		if(NDI_frame_type == NDIlib_frame_type_audio)
 		{
-			const std::size_t dataSize = audioInput.no_samples * audioInput.no_channels;
+			const std::size_t noSamples	= audioInput.no_samples;
+			const std::size_t noChannels	= audioInput.no_channels;
 
-			// Create a NDI audio object and convert it to interleaved float format.
-			NDIlib_audio_frame_interleaved_32f_t audioDataNDI;
-			audioDataNDI.p_data = new float[dataSize];
-			NDIlib_util_audio_to_interleaved_32f_v2(&audioInput, &audioDataNDI);
-			NDIlib_recv_free_audio_v2(pNDI_recv, &audioInput);
+			// The capacity follows the latency settings, it is recomputed by the queue when the output format changes.
+			// The conversion scratch is sized for a pool block once per format change, not on every frame.
+			if (noChannels != NDIdata.channels() || static_cast<std::size_t>(audioInput.sample_rate) != NDIdata.sampleRate())
+			{
+				NDIdata.setChannelNum(noChannels);
+				NDIdata.setSampleRate(audioInput.sample_rate);
+				NDIdata.reserveScratch(NDIPool.blockSize() / std::max<std::size_t>(noChannels, 1));
+			}
 
-			if(audioDataNDI.no_channels != NDIdata.channels  ()) NDIdata.setChannelNum(audioDataNDI.no_channels);
-			if(audioDataNDI.sample_rate != NDIdata.sampleRate()) NDIdata.setSampleRate(audioDataNDI.sample_rate);
-			NDIdata.setCapacity (static_cast<std::size_t>(dataSize * QUEUE_SIZE_MULTIPLIER));
-
-			NDIdata.push(std::move(audioDataNDI.p_data), audioDataNDI.no_samples,2,SAMPLE_RATE);
-
-			delete[] audioDataNDI.p_data;
+			const auto input = NDIDirectInput(NDIdata, audioInput);
+			if (input == NDIInput::kept) continue;
+			if (input == NDIInput::convert) pushConverted(noSamples, noChannels);
+			NDIlib_recv_free_audio_v2(pNDI_recv, &audioInput);
 		}
 		
 	}
 	#pragma endregion
 	
 	#pragma region NDI Clean up
+	// Held frames are read in place by the audio callback : once the stream is closed, the frames still queued go
+	// back to the receiver before it is destroyed.
+	output_stopped.wait(false);
+	NDIdata.clear();
 	NDIlib_recv_destroy(pNDI_recv);
 	NDIlib_destroy();
 	#pragma endregion
@@ -107,14 +245,19 @@ static int portAudioOutputCallback(const void*					   inputBuffer,
 										 PaStreamCallbackFlags	   statusFlags,
 										 void*					   UserData)
 {
-	auto out = static_cast<float*>(outputBuffer);
-	memset(out, 0, framesPerBuffer * 2);
+	const auto out = static_cast<sampleType*>(outputBuffer);
+	const auto end = out + framesPerBuffer * OUTPUT_CHANNELS;
+
+	// Copy straight from the ring storage into the device buffer, interleaving on the way out if the queue is planar,
+	// then conceal whatever is missing. Nothing here may block, print or allocate, underruns are only counted
+	// and reported by the PortAudio thread.
+	const auto next = out + NDIdata.read({ out, end }) * NDIdata.outputChannels();
+	NDIdata.conceal({ next, end });
 	//auto in = static_cast<const float*>(inputBuffer);
 	//MicroInput.setCapacity(8192);
 	//icroInput.setChannelNum(2);
 	//MicroInput.push(in, framesPerBuffer);
-	NDIdata.pop(out, framesPerBuffer, false);
-	//MicroInput.pop(out, framesPerBuffer,true);
+	//outputMixer.mix({ out, end });	// With NDIdata and MicroInput added as inputs, replaces the read above.
 	return paContinue;
 }
 
@@ -127,8 +270,8 @@ void portAudioOutputThread()
 	PaStream* streamOut;
 	PAErrorCheck(Pa_OpenDefaultStream	(&streamOut,					// PaStream ptr
 										 0,								// Input  channels
-										 2,								// Output channels
-										 paFloat32,						// Sample format
+										 OUTPUT_CHANNELS,				// Output channels
+										 PA_SAMPLE_FORMAT,				// Sample format
 									     SAMPLE_RATE,					// Sample rate
 										 PA_BUFFER_SIZE,				// 128
 										 portAudioOutputCallback,		// Callback function called
@@ -139,10 +282,44 @@ void portAudioOutputThread()
 #pragma region PA Callback playing loop
 
 	std::print("playing...\n");
+	underrunStats reported{ 0, 0, 0 };
+	std::uint64_t reportedDrops = 0;
+	long		  reportedPpm	= 0;
+	long		  reportedTarget = 0;
+	jitterStats	  reportedJitter{ 0, 0, 0 };
 	while (!exit_loop)
 	{
 		if (!NDIdata.size()) Pa_AbortStream(streamOut);
 		if (NDIdata.size() && Pa_IsStreamStopped(streamOut)) Pa_StartStream(streamOut);
+
+		// Underruns and overflows are counted on the audio and NDI threads and reported from here.
+		const auto current = NDIdata.underruns();
+		if (current.events != reported.events)
+		{
+			std::print("Warning : {} underruns, {} frames concealed.\n", current.events - reported.events, current.frames - reported.frames);
+			reported = current;
+		}
+		if (const auto drops = NDIdata.dropped(); drops != reportedDrops)
+		{
+			std::print("Warning : {} frames dropped on overflow.\n", drops - reportedDrops);
+			reportedDrops = drops;
+		}
+		if (const auto timeline = NDIdata.jitter(); timeline.gapFrames != reportedJitter.gapFrames || timeline.lateFrames != reportedJitter.lateFrames || timeline.resyncs != reportedJitter.resyncs)
+		{
+			std::print("Warning : {} frames concealed in gaps, {} late frames dropped, {} resyncs.\n", 
+				timeline.gapFrames - reportedJitter.gapFrames, timeline.lateFrames - reportedJitter.lateFrames, timeline.resyncs - reportedJitter.resyncs);
+			reportedJitter = timeline;
+		}
+		if (const auto target = std::lround(NDIdata.targetLatency()); target != reportedTarget)
+		{
+			std::print("Target latency : {} ms, arrival jitter {:.1f} ms.\n", target, NDIdata.arrivalJitter());
+			reportedTarget = target;
+		}
+		if (const auto ppm = std::lround(NDIdata.driftPpm()); ppm != reportedPpm)
+		{
+			std::print("Clock drift : {} ppm.\n", ppm);
+			reportedPpm = ppm;
+		}
 	}
 #pragma endregion
 
@@ -150,6 +327,8 @@ void portAudioOutputThread()
 
 	PAErrorCheck(Pa_StopStream	(streamOut));
 	PAErrorCheck(Pa_CloseStream	(streamOut));
+	output_stopped = true;
+	output_stopped.notify_one();
 	
 #pragma endregion
 }
@@ -159,12 +338,22 @@ int main()
 {
 	NDIlib_initialize();
 	PAErrorCheck(Pa_Initialize());
+	NDIdata.setOutputChannelNum(OUTPUT_CHANNELS);
+	NDIdata.setOutputSampleRate(SAMPLE_RATE);
+	NDIdata.setLatency({ TARGET_LATENCY, MAX_LATENCY, LATENCY_HEADROOM });
+	if constexpr (ZERO_COPY_INPUT) NDIdata.setLayout(sampleLayout::held);
+	else
+	{
+		NDIdata.setDriftCompensation(true);
+		NDIdata.setJitterBuffer(true);
+		NDIdata.setAdaptiveLatency(true, MIN_TARGET_LATENCY, MAX_TARGET_LATENCY);
+	}
 	std::thread ndiThread(NDIAudioTread);
 	std::thread portaudio(portAudioOutputThread);
 
 
-	ndiThread.detach();
 	portaudio.join();
+	ndiThread.join();
 	PAErrorCheck(Pa_Terminate());
 	return 0;
 }
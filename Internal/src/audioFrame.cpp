@@ -1,4 +1,55 @@
 /*
-* Nothing inside, all implementations are in audioFrame.h.
-* Template class lib cpp file to genereate .lib file* 
-*/
\ No newline at end of file
+* All template implementations are in audioFrame.h.
+* Template class lib cpp file to genereate .lib file, it also holds the system specific parts of the headers.
+*/
+#include "queueStorage.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#pragma region Huge pages
+namespace
+{
+    constexpr std::size_t hugePageSize = hugePageAllocator<char>::hugePageSize;
+    constexpr std::size_t roundedSize(const std::size_t bytes, const std::size_t page) { return (bytes + page - 1) / page * page; }
+}
+
+void* mapHugePages(const std::size_t bytes)
+{
+#ifdef _WIN32
+    // Large pages need the SeLockMemoryPrivilege, without it the block is committed on regular pages.
+    const auto large   = GetLargePageMinimum();
+    void*      pointer = large ? VirtualAlloc(nullptr, roundedSize(bytes, large), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE) : nullptr;
+    if (!pointer) pointer = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    return pointer;
+#else
+    // Reserved huge pages first, then regular pages with a transparent huge page hint.
+    const auto mapped  = roundedSize(bytes, hugePageSize);
+    void*      pointer = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pointer != MAP_FAILED) return pointer;
+
+    pointer = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pointer == MAP_FAILED) return nullptr;
+    madvise(pointer, mapped, MADV_HUGEPAGE);
+    return pointer;
+#endif
+}
+
+void unmapHugePages(void* pointer, const std::size_t bytes)
+{
+#ifdef _WIN32
+    VirtualFree(pointer, 0, MEM_RELEASE);
+#else
+    munmap(pointer, roundedSize(bytes, hugePageSize));
+#endif
+}
+#pragma endregion
@@ -1,97 +1,1100 @@
-﻿#include <iostream>
-#include <list>
+﻿#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <numbers>
 #include <print>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
-int main() {
-	/*conversion draft
-	std::list<int> a = {1, 2, 3, 4, 5, 6, 7, 8, 9 ,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32,33,34,35,36};
-	int x = 6; 
-	int y = 2; 
+#include "audioFrame.h"
+#include "audioKernels.h"
+#include "audioMixer.h"
+#include "framePool.h"
 
-	int copyCount			= std::min(x, y);
-	int modificationCount	= std::abs(x - y);
-	
+#pragma region Allocation counting
+/**
+ * @brief Global operator new replaced by a counter, so that a test can check that a code path never reaches the heap.
+ * The array and nothrow forms forward to these ones.
+ */
+static std::atomic<std::size_t> allocations{ 0 };
 
-	if (x < y)
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (const auto pointer = std::malloc(size ? size : 1)) return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	const auto boundary = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+	if (const auto pointer = _aligned_malloc(size ? size : 1, boundary)) return pointer;
+#else
+	if (const auto pointer = std::aligned_alloc(boundary, (size + boundary) / boundary * boundary)) return pointer;
+#endif
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept							{ std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept				{ std::free(pointer); }
+#ifdef _WIN32
+void operator delete(void* pointer, std::align_val_t) noexcept				{ _aligned_free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept	{ _aligned_free(pointer); }
+#else
+void operator delete(void* pointer, std::align_val_t) noexcept				{ std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept	{ std::free(pointer); }
+#endif
+#pragma endregion
+
+#pragma region Tests
+/**
+ * @brief Steady state of the NDI path : frame pool buffers, push with channel conversion and resampling, pop.
+ * 
+ * The queue is warmed up first, as the NDI thread does with reserveScratch and its first blocks. From then on
+ * no push or pop may allocate, with every resampler engine and with drift compensation on.
+ */
+static bool steadyStateAllocations()
+{
+	constexpr std::size_t inputChannels	= 6;
+	constexpr std::size_t outputChannels	= 2;
+	constexpr std::size_t blockFrames		= 1024;
+	constexpr std::size_t rounds			= 500;
+
+	framePool<float> pool(blockFrames * inputChannels, 4);
+	std::vector<float> output(blockFrames * 2 * outputChannels);
+	auto passed = true;
+
+	for (const auto quality : { resampleQuality::native, resampleQuality::fastest, resampleQuality::linear })
 	{
-		for (auto iter = std::next(a.begin(), copyCount);iter != a.end();std::advance(iter, copyCount+ modificationCount))
+		for (const auto drift : { false, true })
 		{
-			a.insert(iter, modificationCount, 0);
+			audioQueue<float> queue(0);
+			queue.setChannelNum(inputChannels);
+			queue.setSampleRate(44100);
+			queue.setOutputChannelNum(outputChannels);
+			queue.setOutputSampleRate(48000);
+			queue.setLatency({ std::chrono::milliseconds(40), std::chrono::milliseconds(200), std::chrono::milliseconds(20) });
+			queue.setResampleQuality(quality);
+			queue.setDriftCompensation(drift);
+			queue.reserveScratch(blockFrames);
+
+			// The consumer pops what the resampler outputs on average, so the fill level stays around the target.
+			const auto popFrames = blockFrames * 48000 / 44100;
+			std::size_t counted = 0;
+			for (std::size_t round = 0; round < rounds * 2; round++)
+			{
+				if (round == rounds) counted = allocations.load(std::memory_order_relaxed);
+
+				auto block = pool.acquire();
+				std::fill(block.begin(), block.end(), 0.25f);
+				auto in = block.data();
+				queue.push(std::move(in), blockFrames, outputChannels, 48000);
+				pool.release(block);
+
+				auto out = output.data();
+				queue.pop(out, popFrames);
+			}
+			counted = allocations.load(std::memory_order_relaxed) - counted;
+
+			if (counted)
+			{
+				std::print("allocations : {} in {} steady state rounds, quality {}, drift compensation {}.\n", counted, rounds, static_cast<int>(quality), drift);
+				passed = false;
+			}
 		}
-		a.insert(a.end(), modificationCount, 0);
 	}
-	else //Convert audio from mono/stereo to a multi-channel.
+	return passed;
+}
+
+/**
+ * @brief Prints a failed check of a test.
+ */
+static bool check(const bool condition, const std::string_view test, const std::string_view what)
+{
+	if (!condition) std::print("{} : {}.\n", test, what);
+	return condition;
+}
+
+/**
+ * @brief A resize requested before the consumer acknowledged the previous one is kept, and applied by the first
+ * write once the consumer has switched storage.
+ */
+static bool deferredResize()
+{
+	audioQueue<float> queue(8);
+	queue.setCapacity(16);
+	queue.setCapacity(32);
+	auto passed = check(queue.capacity() == 16, "resize", "the second resize went through before the handshake");
+
+	const std::array<float, 4> samples = { 1.0f, 2.0f, 3.0f, 4.0f };
+	std::array<float, 4> out{};
+	for (auto round = 0; round < 2; round++)
+	{
+		passed &= check(queue.write(samples) == samples.size(), "resize", "samples not written");
+		passed &= check(queue.read(out) == out.size() && out == samples, "resize", "samples not read back");
+	}
+	passed &= check(queue.capacity() == 32, "resize", "the deferred resize was lost");
+	return passed;
+}
+
+/**
+ * @brief Writes rounds of two blocks of three-channel frames into a planar power-of-two queue and reads each round
+ * back, long enough to wrap the planes. Returns false on the first round that is not read back as written.
+ */
+static bool planarRoundTrip(audioQueue<float, powerOfTwoIndex>& queue, const std::string_view test)
+{
+	std::array<float, 18> frames{};
+	std::array<float, 18> out{};
+
+	// The consumer switches to the reshaped storage first, until then writes are bounded by the previous one.
+	queue.read(out);
+	for (std::size_t round = 0; round < 8; round++)
+	{
+		for (std::size_t i = 0; i < frames.size(); i++) frames[i] = static_cast<float>(round * frames.size() + i);
+		const auto written = queue.write(std::span(frames).first(9)) + queue.write(std::span(frames).last(9));
+		if (!check(written == 6, test, "frames not written")) return false;
+		if (!check(queue.read(out) == 6 && out == frames, test, "frames not read back in order")) return false;
+	}
+	return true;
+}
+
+/**
+ * @brief A channel count change reshapes planar storage into planes the index policy can mask, with or without
+ * latency settings, and a reshape deferred by a pending resize holds writes back until it is done.
+ */
+static bool planarChannelChange()
+{
+	audioQueue<float, powerOfTwoIndex> queue(16);
+	queue.setLayout(sampleLayout::planar);
+	queue.setOutputChannelNum(3);
+	auto passed = check(queue.capacity() == 24, "planar", "storage not reshaped into three planes of eight frames");
+	passed &= planarRoundTrip(queue, "planar");
+
+	audioQueue<float, powerOfTwoIndex> deferred(16);
+	deferred.setLayout(sampleLayout::planar);
+	deferred.setCapacity(32);
+	deferred.setOutputChannelNum(3);
+	const std::array<float, 9> frames{};
+	passed &= check(deferred.write(frames) == 0, "planar", "frames written before the storage was reshaped");
+
+	passed &= planarRoundTrip(deferred, "planar deferred");
+	return passed;
+}
+
+/**
+ * @brief Under dropOldest the producer reclaims frames while the consumer reads. Every block read must still be a
+ * run of consecutive frames, later than the previous block, and peek must refuse to hand out a view.
+ */
+static bool dropOldestReads()
+{
+	constexpr std::size_t blockFrames	= 48;
+	constexpr std::size_t blocks		= 20000;
+
+	audioQueue<float> queue(64);
+	queue.setOverflowPolicy(overflowPolicy::dropOldest);
+	std::atomic<bool> done{ false };
+	std::thread producer([&]
+	{
+		std::array<float, blockFrames> block{};
+		for (std::size_t b = 0; b < blocks; b++)
+		{
+			for (std::size_t i = 0; i < blockFrames; i++) block[i] = static_cast<float>(b * blockFrames + i);
+			queue.push(block.data(), blockFrames, 1, 44100);
+		}
+		done.store(true, std::memory_order_release);
+	});
+
+	std::array<float, 32> out{};
+	audioQueue<float> viewed(64);
+	viewed.setOverflowPolicy(overflowPolicy::dropOldest);
+	viewed.write(out);
+	auto passed = check(viewed.peek(1).empty(), "dropOldest", "peek handed out a view the producer may overwrite");
+
+	float last = -1.0f;
+	while (passed)
+	{
+		const auto finished = done.load(std::memory_order_acquire);
+		const auto frames   = queue.read(out);
+		for (std::size_t i = 0; i < frames && passed; i++)
+		{
+			passed = check(out[i] > last && (i == 0 || out[i] == out[i - 1] + 1.0f), "dropOldest", "a block was torn or read out of order");
+			last   = out[i];
+		}
+		if (finished && !frames) break;
+		if (!frames) std::this_thread::yield();
+	}
+	producer.join();
+	return passed;
+}
+
+/**
+ * @brief Every block of a pool over a 24 byte element, which does not divide the 64 byte alignment, starts on the
+ * alignment and blocks are handed out once until released.
+ */
+static bool framePoolAlignment()
+{
+	struct oddFrame { double value[3]; };
+	auto passed = true;
+	for (const std::size_t length : { 1, 3, 7, 8, 9 })
+	{
+		framePool<oddFrame> pool(length, 5);
+		std::vector<std::span<oddFrame>> blocks;
+		for (auto block = pool.acquire(); !block.empty(); block = pool.acquire()) blocks.push_back(block);
+		passed &= check(blocks.size() == 5, "framePool", "blocks lost");
+		for (const auto block : blocks)
+			passed &= check(block.size() == length && reinterpret_cast<std::uintptr_t>(block.data()) % 64 == 0, "framePool", "block off the alignment");
+
+		pool.release(blocks[2]);
+		passed &= check(pool.acquire().data() == blocks[2].data(), "framePool", "released block not handed out again");
+	}
+	return passed;
+}
+
+/**
+ * @brief Largest difference between two sample buffers, in steps of the sample type so that every type compares alike.
+ */
+template<typename T>
+static double largestDifference(const std::vector<T>& result, const std::vector<T>& reference)
+{
+	double largest = 0.0;
+	for (std::size_t i = 0; i < result.size(); i++)
+		largest = std::max(largest, std::abs(toNormalized(result[i]) - toNormalized(reference[i])) * fullScale<T>());
+	return largest;
+}
+
+/**
+ * @brief Every vector kernel against its scalar reference, on every length from 0 to 67 so that each vector width
+ * leaves every tail, and on spans starting 0 to 3 samples past the allocation. The whole output buffers are compared,
+ * a kernel writing past its span differs too. Floats reach 1.5 times full scale so that conversions and the clip
+ * saturate. Integer samples also go through a float and back, exactly for int16 and int24, within the float
+ * precision for int32.
+ */
+static bool kernelsAgainstScalar()
+{
+	using namespace audioKernels;
+	constexpr std::size_t longest = 67;
+	constexpr std::size_t offsets = 4;
+	constexpr std::size_t size    = 8 * (longest + offsets);
+
+	// Full scale, the clip knee and the extremes of each integer type come first.
+	std::vector<float>        floats(size);
+	std::vector<double>       doubles(size);
+	std::vector<short>        shorts(size);
+	std::vector<int24>        packed(size);
+	std::vector<std::int32_t> ints  (size);
+	for (std::size_t i = 0; i < size; i++)
 	{
-		auto naut = a.end();
-		for (auto iter = std::next(a.begin(), copyCount); iter != a.end(); std::advance(iter, copyCount))
+		floats [i] = 1.5f * std::sin(0.37f * static_cast<float>(i) + 0.1f);
+		doubles[i] = static_cast<double>(floats[i]) * (1.0 + 1e-9);
+		ints   [i] = static_cast<std::int32_t>(static_cast<std::uint32_t>(i) * 2654435761u);
+		shorts [i] = static_cast<short>(ints[i] >> 16);
+		packed [i] = int24(ints[i] >> 8);
+	}
+	std::ranges::copy(std::array{ 1.0f, -1.0f, softClipKnee, -softClipKnee, softClipTop, -2.0f }, floats.begin());
+	ints  [0] = INT32_MIN;	ints  [1] = INT32_MAX;
+	shorts[0] = -32768;		shorts[1] = 32767;
+	packed[0] = -8388608;	packed[1] = 8388607;
+
+	std::vector<float>        simd(size), scalar(size), simdRight(size), scalarRight(size);
+	std::vector<double>       simdDoubles(size), scalarDoubles(size);
+	std::vector<short>        simdShorts(size), scalarShorts(size);
+	std::vector<int24>        simdPacked(size), scalarPacked(size);
+	std::vector<std::int32_t> simdInts(size), scalarInts(size);
+	const std::array<float, 8> gainsL = { 0.5f, -0.25f, 0.7f, 0.1f, 1.2f, -0.9f, 0.3f, 0.05f };
+	const std::array<float, 8> gainsR = { -0.4f, 0.6f, 0.2f, 0.9f, -1.1f, 0.15f, 0.8f, -0.35f };
+
+	auto passed = true;
+	for (std::size_t length = 0; length <= longest; length++)
+		for (std::size_t offset = 0; offset < offsets; offset++)
 		{
-			std::print("current iter pos : {}\n", *iter);
-			for (auto i = 0; i < modificationCount; i++)
+			const auto agrees = [&](const std::string_view kernel, const double difference, const double tolerance)
 			{
-				if (std::next(iter, 1) != a.end())
-					iter = a.erase(iter);
-				else
-				{
-					a.erase(iter);
-					goto x;
-				}
+				if (difference <= tolerance) return true;
+				std::print("kernels : {} is {} off its scalar reference on {} samples at offset {}.\n", kernel, difference, length, offset);
+				return false;
+			};
+			const auto in    = floats.data() + offset;
+			const auto other = floats.data() + size / 2 + offset;
+			const auto out   = simd  .data() + offset;
+			const auto ref   = scalar.data() + offset;
+
+			passed &= agrees("dotProduct", std::abs(dotProduct(in, other, length) - dotProductScalar(in, other, length)), 1e-4);
+
+			simd = scalar = floats;
+			monoToStereo(in, out, length, 0.7f, -0.3f);
+			for (std::size_t i = 0; i < length; i++) { ref[2 * i] = in[i] * 0.7f; ref[2 * i + 1] = in[i] * -0.3f; }
+			passed &= agrees("monoToStereo", largestDifference(simd, scalar), 0.0);
+
+			simd = scalar = floats;
+			stereoToMono(in, out, length, 0.7f, -0.3f);
+			for (std::size_t i = 0; i < length; i++) ref[i] = in[2 * i] * 0.7f + in[2 * i + 1] * -0.3f;
+			passed &= agrees("stereoToMono", largestDifference(simd, scalar), 1e-6);
+
+			simd = scalar = floats;
+			mixToStereo<6>(in, out, length, gainsL.data(), gainsR.data());
+			for (std::size_t f = 0; f < length; f++)
+			{
+				ref[2 * f] = ref[2 * f + 1] = 0.0f;
+				for (std::size_t c = 0; c < 6; c++) { ref[2 * f] += in[6 * f + c] * gainsL[c]; ref[2 * f + 1] += in[6 * f + c] * gainsR[c]; }
+			}
+			passed &= agrees("mixToStereo", largestDifference(simd, scalar), 1e-5);
+
+			simd = scalar = floats;
+			interleaveStereo(in, other, out, length);
+			for (std::size_t i = 0; i < length; i++) { ref[2 * i] = in[i]; ref[2 * i + 1] = other[i]; }
+			passed &= agrees("interleaveStereo", largestDifference(simd, scalar), 0.0);
+
+			simd = scalar = simdRight = scalarRight = floats;
+			deinterleaveStereo(in, out, simdRight.data() + offset, length);
+			for (std::size_t i = 0; i < length; i++) { ref[i] = in[2 * i]; scalarRight[offset + i] = in[2 * i + 1]; }
+			passed &= agrees("deinterleaveStereo", std::max(largestDifference(simd, scalar), largestDifference(simdRight, scalarRight)), 0.0);
+
+			simd = scalar = floats;
+			shortToFloat      (shorts.data() + offset, out, length);
+			shortToFloatScalar(shorts.data() + offset, ref, length);
+			passed &= agrees("shortToFloat", largestDifference(simd, scalar), 0.0);
+
+			simdShorts = scalarShorts = shorts;
+			floatToShort      (in, simdShorts  .data() + offset, length);
+			floatToShortScalar(in, scalarShorts.data() + offset, length);
+			passed &= agrees("floatToShort", largestDifference(simdShorts, scalarShorts), 0.0);
+
+			simd = scalar = floats;
+			int32ToFloat(ints.data() + offset, out, length);
+			for (std::size_t i = 0; i < length; i++) ref[i] = static_cast<float>(toNormalized(ints[offset + i]));
+			passed &= agrees("int32ToFloat", largestDifference(simd, scalar), 0.0);
+
+			simdInts = scalarInts = ints;
+			floatToInt32(in, simdInts.data() + offset, length);
+			for (std::size_t i = 0; i < length; i++) scalarInts[offset + i] = fromNormalized<std::int32_t>(in[i]);
+			passed &= agrees("floatToInt32", largestDifference(simdInts, scalarInts), 0.0);
+
+			simdDoubles = scalarDoubles = doubles;
+			floatToDouble(in, simdDoubles.data() + offset, length);
+			for (std::size_t i = 0; i < length; i++) scalarDoubles[offset + i] = in[i];
+			passed &= agrees("floatToDouble", largestDifference(simdDoubles, scalarDoubles), 0.0);
+
+			simd = scalar = floats;
+			doubleToFloat(doubles.data() + offset, out, length);
+			for (std::size_t i = 0; i < length; i++) ref[i] = static_cast<float>(doubles[offset + i]);
+			passed &= agrees("doubleToFloat", largestDifference(simd, scalar), 0.0);
+
+			simd = scalar = floats;
+			mixAdd      (other, out, length, 0.6f);
+			mixAddScalar(other, ref, length, 0.6f);
+			passed &= agrees("mixAdd", largestDifference(simd, scalar), 1e-6);
+
+			simdShorts = scalarShorts = shorts;
+			mixAdd      (shorts.data() + size / 2 + offset, simdShorts  .data() + offset, length, 1.7f);
+			mixAddScalar(shorts.data() + size / 2 + offset, scalarShorts.data() + offset, length, 1.7f);
+			passed &= agrees("mixAdd int16", largestDifference(simdShorts, scalarShorts), 0.0);
+
+			simd = scalar = floats;
+			softClip(out, length);
+			for (std::size_t i = 0; i < length; i++) ref[i] = softClipScalar(ref[i]);
+			passed &= agrees("softClip", largestDifference(simd, scalar), 1e-6);
+
+			simd = scalar = floats;
+			applyGain      (out, length, -0.45f);
+			applyGainScalar(ref, length, -0.45f);
+			passed &= agrees("applyGain", largestDifference(simd, scalar), 0.0);
+
+			for (const std::size_t channels : { 1, 2, 3, 4, 8 })
+			{
+				simd = scalar = floats;
+				gainRamp      (out, length, channels, 0.2f, 0.01f);
+				gainRampScalar(ref, length, channels, 0.2f, 0.01f);
+				passed &= agrees("gainRamp", largestDifference(simd, scalar), 1e-5);
+			}
+
+			// Round trips through float, the conversions pick their vector kernel.
+			simdShorts = shorts;
+			convertSamples(shorts.data() + offset, out, length);
+			convertSamples(out, simdShorts.data() + offset, length);
+			passed &= agrees("int16 round trip", largestDifference(simdShorts, shorts), 0.0);
+
+			simdPacked = packed;
+			convertSamples(packed.data() + offset, out, length);
+			convertSamples(out, simdPacked.data() + offset, length);
+			passed &= agrees("int24 round trip", largestDifference(simdPacked, packed), 0.0);
+
+			simdInts = ints;
+			convertSamples(ints.data() + offset, out, length);
+			convertSamples(out, simdInts.data() + offset, length);
+			passed &= agrees("int32 round trip", largestDifference(simdInts, ints), 128.0);
+
+			simdPacked = scalarPacked = packed;
+			convertSamples      (in, simdPacked  .data() + offset, length);
+			convertSamplesScalar(in, scalarPacked.data() + offset, length);
+			passed &= agrees("float to int24", largestDifference(simdPacked, scalarPacked), 0.0);
+		}
+
+	// Past full scale every integer type saturates to its extremes, full scale itself is one step past the top.
+	const auto saturates = [](auto lowest, auto top)
+	{
+		using sample = decltype(lowest);
+		return fromNormalized<sample>(-1.5) == lowest && fromNormalized<sample>(-1.0) == lowest
+			&& fromNormalized<sample>( 1.0) == top    && fromNormalized<sample>( 1.5) == top;
+	};
+	passed &= check(saturates(short(-32768), short(32767)), "kernels", "int16 does not saturate");
+	passed &= check(saturates(INT32_MIN, INT32_MAX), "kernels", "int32 does not saturate");
+	passed &= check(static_cast<std::int32_t>(fromNormalized<int24>(1.5)) == 8388607 && static_cast<std::int32_t>(fromNormalized<int24>(-1.5)) == -8388608,
+		"kernels", "int24 does not saturate");
+	return passed;
+}
+
+/**
+ * @brief Jitter buffer on a 48 kHz mono queue fed with 10 ms blocks : a block arriving 10 ms after the previous one
+ * ended is preceded by 480 frames of silence, a block starting 5 ms before the previous one ended loses its
+ * first 240 frames, and everything else is read back in sender order.
+ */
+static bool jitterGapAndLate()
+{
+	constexpr std::size_t block = 480;
+	constexpr mediaTicks  tenMs(100'000);
+	audioQueue<float> queue(8192);
+	queue.setChannelNum(1);
+	queue.setSampleRate(48000);
+	queue.setJitterBuffer(true);
+
+	const auto send = [&](const float first, const mediaTicks timestamp)
+	{
+		std::vector<float> samples(block);
+		for (std::size_t i = 0; i < block; i++) samples[i] = first + static_cast<float>(i);
+		queue.push(samples.data(), block, 1, 48000, timestamp);
+	};
+	send(   1.0f, mediaTicks(0));
+	send(1001.0f, 2 * tenMs);
+	send(2001.0f, 2 * tenMs + tenMs / 2);
+
+	const auto stats = queue.jitter();
+	auto passed = check(stats.gapFrames == block, "jitter", "the gap was not filled");
+	passed &= check(stats.lateFrames == block / 2 && !stats.resyncs, "jitter", "the late frames were not dropped");
+
+	std::vector<float> out(3 * block + block / 2);
+	passed &= check(queue.read(out) == out.size(), "jitter", "frames missing");
+	for (std::size_t i = 0; i < out.size(); i++)
+	{
+		const auto expected = i < block ? 1.0f + static_cast<float>(i) : i < 2 * block ? 0.0f : i < 3 * block ? 1001.0f + static_cast<float>(i - 2 * block) : 2001.0f + static_cast<float>(i - 3 * block + block / 2);
+		if (out[i] != expected) return check(false, "jitter", "frames out of the sender timeline");
+	}
+	return passed;
+}
+
+/**
+ * @brief Frames pushed with another channel count come out through the matrix : every output sample is the gain
+ * weighted sum of its input frame. Empty gains check the default matrix of the layout, given ones go through
+ * setChannelMatrix.
+ */
+static bool matrixMix(const std::size_t inputs, const std::size_t outputs, const std::span<const float> gains, const std::span<const float> custom)
+{
+	constexpr std::size_t frames = 37;
+	audioQueue<float> queue(1024);
+	queue.setChannelNum(inputs);
+	queue.setSampleRate(48000);
+	queue.setOutputChannelNum(outputs);
+	queue.setOutputSampleRate(48000);
+	if (!custom.empty()) queue.setChannelMatrix(custom);
 
-			}		
+	std::vector<float> in(frames * inputs);
+	for (std::size_t i = 0; i < in.size(); i++) in[i] = 0.9f * std::sin(0.7f * static_cast<float>(i));
+	queue.push(in.data(), frames, outputs, 48000);
+
+	std::vector<float> out(frames * outputs);
+	if (queue.read(out) != frames) return check(false, "matrix", "frames missing");
+	for (std::size_t f = 0; f < frames; f++)
+		for (std::size_t o = 0; o < outputs; o++)
+		{
+			float expected = 0.0f;
+			for (std::size_t i = 0; i < inputs; i++) expected += in[f * inputs + i] * gains[o * inputs + i];
+			if (std::abs(out[f * outputs + o] - expected) > 1e-5f)
+			{
+				std::print("matrix : {} to {} channels, output {} of frame {} is {} instead of {}.\n", inputs, outputs, o, f, out[f * outputs + o], expected);
+				return false;
+			}
 		}
+	return true;
+}
+
+/**
+ * @brief Default down-mixes and up-mix of every specialised kernel, a custom channel subset and a generic matrix.
+ */
+static bool channelMatrixMixes()
+{
+	constexpr auto m3 = 0.70710678f;
+	const std::vector<float> monoToStereo	= { 1.0f, 1.0f };
+	const std::vector<float> stereoToMono	= { 0.5f, 0.5f };
+	const std::vector<float> surround51		= { 1.0f, 0.0f, m3, 0.0f, m3, 0.0f,
+												0.0f, 1.0f, m3, 0.0f, 0.0f, m3 };
+	const std::vector<float> surround71		= { 1.0f, 0.0f, m3, 0.0f, m3, 0.0f, m3, 0.0f,
+												0.0f, 1.0f, m3, 0.0f, 0.0f, m3, 0.0f, m3 };
+	const std::vector<float> subset			= { 1.0f, 0.0f, 0.0f, 0.0f,
+												0.0f, 1.0f, 0.0f, 0.0f };
+	const std::vector<float> quadToStereo	= { 0.6f, 0.1f, 0.4f, 0.0f,
+												0.1f, 0.6f, 0.0f, 0.4f };
+	const std::vector<float> generic		= { 1.0f, 0.0f, 0.0f,
+												0.0f, 1.0f, 0.0f,
+												0.5f, 0.5f, 0.0f,
+												0.0f, -0.3f, 0.8f };
+
+	auto passed = matrixMix(1, 2, monoToStereo, {});
+	passed &= matrixMix(2, 1, stereoToMono, {});
+	passed &= matrixMix(6, 2, surround51,   {});
+	passed &= matrixMix(8, 2, surround71,   {});
+	passed &= matrixMix(4, 2, subset,       subset);
+	passed &= matrixMix(4, 2, quadToStereo, quadToStereo);
+	passed &= matrixMix(3, 4, generic,      generic);
+	return passed;
+}
+
+/**
+ * @brief Two stereo inputs, one interleaved and one planar, summed past full scale. Float output follows the soft
+ * clip curve, untouched under the knee and never past full scale, int16 output saturates at both ends.
+ */
+static bool mixerSaturation()
+{
+	constexpr std::size_t frames = 100;
+	constexpr std::size_t block  = 32;
+	auto passed = true;
+
+	const auto stereoQueue = []<typename T>(audioQueue<T>& queue, const sampleLayout layout)
+	{
+		queue.setChannelNum(2);
+		queue.setSampleRate(48000);
+		queue.setOutputChannelNum(2);
+		queue.setOutputSampleRate(48000);
+		queue.setLayout(layout);
+	};
+
+	for (const auto clip : { false, true })
+	{
+		audioQueue<float> interleaved(1024), planar(1024);
+		stereoQueue(interleaved, sampleLayout::interleaved);
+		stereoQueue(planar,      sampleLayout::planar);
+
+		// Sums from silence up to twice full scale, of both signs.
+		std::vector<float> a(frames * 2), b(frames * 2);
+		for (std::size_t i = 0; i < a.size(); i++)
+		{
+			a[i] = (i % 2 ? -1.0f : 1.0f) * static_cast<float>(i) / static_cast<float>(a.size());
+			b[i] = a[i] * 0.95f;
+		}
+		interleaved.write(a);
+		planar     .write(b);
+
+		audioMixer<float> mixer(2, block);
+		mixer.addInput(interleaved);
+		mixer.addInput(planar);
+		mixer.setSoftClip(clip);
+		std::vector<float> out(frames * 2);
+		mixer.mix(out);
+
+		for (std::size_t i = 0; i < out.size(); i++)
+		{
+			const auto sum = a[i] + b[i];
+			if (std::abs(out[i] - (clip ? audioKernels::softClipScalar(sum) : sum)) > 1e-6f || (clip && std::abs(out[i]) > 1.0f + 1e-6f))
+				return check(false, "mixer", clip ? "float output off the soft clip curve" : "float output altered without soft clip");
+		}
+		passed &= check(!clip || std::abs(out[frames * 2 - 1]) > 1.0f - 1e-6f, "mixer", "twice full scale not clipped to full scale");
 	}
-	x:
-	for (const auto& element : a) 
+
+	audioQueue<short> loud(1024), louder(1024);
+	stereoQueue(loud,   sampleLayout::interleaved);
+	stereoQueue(louder, sampleLayout::planar);
+	std::vector<short> a(frames * 2), b(frames * 2);
+	for (std::size_t i = 0; i < a.size(); i++)
 	{
-		std::cout << element << " ";
+		a[i] = static_cast<short>(i % 2 ? -30000 : 30000);
+		b[i] = static_cast<short>(i % 2 ? -20000 : i < 20 ? -20000 : 20000);
 	}
-	std::cout << std::endl;
-*/
-	size_t outputSampleRate = 48000;
-	size_t audioSampleRate = 44100;
-	size_t frames = 8192;
-	uint8_t outputChannelNum = 2;
-	const auto resampleRatio = static_cast<double>(outputSampleRate) / static_cast<double>(audioSampleRate);
-	const auto newSize = static_cast<size_t>(std::ceil(static_cast<double>(frames) * static_cast<double>(outputChannelNum) * resampleRatio));
-	std::print("the ratio : {}, newSize : {}\n", resampleRatio, newSize);
-	return 0;
+	loud  .write(a);
+	louder.write(b);
+
+	audioMixer<short> mixer(2, block);
+	mixer.addInput(loud);
+	mixer.addInput(louder);
+	std::vector<short> out(frames * 2);
+	mixer.mix(out);
+	for (std::size_t i = 0; i < out.size(); i++)
+		if (out[i] != std::clamp(a[i] + b[i], -32768, 32767)) return check(false, "mixer", "int16 output does not saturate");
+	return passed;
 }
 
+/**
+ * @brief A gain change ramps over gainRampFrames frames and lands on its target : the ramp falls steadily, its last
+ * frame and every frame after it carry the target, and the queue reports the gain as settled. A ramp back to unity
+ * ends at exactly 1.
+ */
+static bool gainRampEndpoint()
+{
+	constexpr std::size_t frames = 3 * gainRampFrames;
+	auto passed = true;
+	for (const auto layout : { sampleLayout::interleaved, sampleLayout::planar })
+	{
+		audioQueue<float> queue(4096);
+		queue.setChannelNum(2);
+		queue.setSampleRate(48000);
+		queue.setOutputChannelNum(2);
+		queue.setOutputSampleRate(48000);
+		queue.setLayout(layout);
 
+		const std::vector<float> ones(frames * 2, 1.0f);
+		std::vector<float> out(frames * 2);
+		for (const auto target : { 0.25f, 1.0f })
+		{
+			queue.setGain(target);
+			queue.write(ones);
+			// Blocks that do not divide the ramp, so that it spans several reads.
+			for (std::size_t done = 0; done < frames;)
+				done += queue.read(std::span(out).subspan(done * 2, std::min<std::size_t>(100, frames - done) * 2));
 
+			const auto from = target == 1.0f ? 0.25f : 1.0f;
+			for (std::size_t f = 0; f < frames; f++)
+			{
+				const auto ramping  = f + 1 < gainRampFrames;
+				const auto previous = f ? out[(f - 1) * 2] : from;
+				const auto steady   = ramping ? std::abs(out[f * 2] - target) < std::abs(previous - target) : out[f * 2] == target;
+				if (!steady || out[f * 2] != out[f * 2 + 1]) return check(false, "gainRamp", ramping ? "the ramp does not head for its target" : "the ramp does not land on its target");
+			}
+			passed &= check(queue.gainSettled() && queue.currentGain() == target, "gainRamp", "gain not settled after the ramp");
+		}
+	}
+	return passed;
+}
+#pragma endregion
+
+#pragma region Benchmarks
+/**
+ * @brief Ring with the index layout audioQueue had before its producer and consumer state were split.
+ * 
+ * head, tail and the element count share one cache line, both threads update the count and neither keeps a copy
+ * of the opposite index. Copies are in bulk like audioQueue::write and read, so that only the layout differs.
+ */
+class sharedLineRing
+{
+	private : //Class members
+		std::vector<float>			queue;
+		std::atomic<std::size_t>	head;
+		std::atomic<std::size_t>	tail;
+		std::atomic<std::size_t>	elementCount;
+
+	public : //Public member functions
+		sharedLineRing(const std::size_t capacity) : queue(capacity + 1), head(0), tail(0), elementCount(0) {}
+
+		std::size_t write(std::span<const float> data)
+		{
+			const auto currentTail	= tail.load(std::memory_order_relaxed);
+			const auto free		= (head.load(std::memory_order_acquire) + queue.size() - currentTail - 1) % queue.size();
+			const auto count		= std::min(free, data.size());
+			const auto firstPart	= std::min(count, queue.size() - currentTail);
+			std::copy_n(data.begin(),				firstPart,			queue.begin() + currentTail);
+			std::copy_n(data.begin() + firstPart,	count - firstPart,	queue.begin());
+			tail.store((currentTail + count) % queue.size(), std::memory_order_release);
+			elementCount.fetch_add(count, std::memory_order_relaxed);
+			return count;
+		}
+
+		std::size_t read(std::span<float> data)
+		{
+			const auto currentHead	= head.load(std::memory_order_relaxed);
+			const auto used		= (tail.load(std::memory_order_acquire) + queue.size() - currentHead) % queue.size();
+			const auto count		= std::min(used, data.size());
+			const auto firstPart	= std::min(count, queue.size() - currentHead);
+			std::copy_n(queue.begin() + currentHead,	firstPart,			data.begin());
+			std::copy_n(queue.begin(),					count - firstPart,	data.begin() + firstPart);
+			head.store((currentHead + count) % queue.size(), std::memory_order_release);
+			elementCount.fetch_sub(count, std::memory_order_relaxed);
+			return count;
+		}
+};
+
+/**
+ * @brief Samples per second through a ring, the producer on its own thread and the consumer on the calling one.
+ * The producer sends a running count, exact in a float below 2^24 and wrapped there, and the consumer checks that
+ * every sample arrives once and in order. Returns 0 when one does not.
+ */
+template<typename ring>
+static double transferRate(ring& queue, const std::size_t block, const std::size_t total)
+{
+	constexpr std::size_t sequenceWrap = std::size_t(1) << 24;
+	std::vector<float> source(block);
+	std::vector<float> sink(block);
+	auto inOrder = true;
 
+	// A side that made no progress yields, which only matters when both sides share a core.
+	const auto start = std::chrono::steady_clock::now();
+	std::thread producer([&]
+	{
+		for (std::size_t sent = 0; sent < total;)
+		{
+			const auto size = std::min(block, total - sent);
+			for (std::size_t i = 0; i < size; i++) source[i] = static_cast<float>((sent + i) % sequenceWrap);
+			const auto count = queue.write(std::span(source).first(size));
+			if (!count) std::this_thread::yield();
+			sent += count;
+		}
+	});
+	for (std::size_t received = 0; received < total;)
+	{
+		const auto count = queue.read(std::span(sink).first(std::min(block, total - received)));
+		if (!count) std::this_thread::yield();
+		for (std::size_t i = 0; i < count && inOrder; i++) inOrder = sink[i] == static_cast<float>((received + i) % sequenceWrap);
+		received += count;
+	}
+	producer.join();
 
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return inOrder ? static_cast<double>(total) / elapsed : 0.0;
+}
+
+/**
+ * @brief Cross-core throughput of the split index layout against the shared cache line layout, mono float blocks
+ * from a few samples, where index traffic dominates, up to a PortAudio sized block.
+ */
+static bool crossCoreThroughput()
+{
+	constexpr std::size_t capacity	= 4096;
+	constexpr std::size_t total		= std::size_t(1) << 25;
+
+	if (std::thread::hardware_concurrency() < 2) std::print("spsc : fewer than two hardware threads, both sides share a core.\n");
+	for (const std::size_t block : { 16, 64, 256 })
+	{
+		sharedLineRing									shared(capacity);
+		audioQueue<float>								split(capacity);
+		audioQueue<float, powerOfTwoIndex>				masked(capacity);
+
+		const auto sharedRate	= transferRate(shared, block, total);
+		const auto splitRate	= transferRate(split,  block, total);
+		const auto maskedRate	= transferRate(masked, block, total);
+		if (!sharedRate || !splitRate || !maskedRate)
+		{
+			std::print("spsc : block {} lost or reordered samples.\n", block);
+			return false;
+		}
+		std::print("spsc block {:>4} : shared line {:8.1f} Msamples/s, split {:8.1f} Msamples/s (x{:.2f}), split power of two {:8.1f} Msamples/s (x{:.2f})\n",
+			block, sharedRate / 1e6, splitRate / 1e6, splitRate / sharedRate, maskedRate / 1e6, maskedRate / sharedRate);
+	}
+	return true;
+}
 
+/**
+ * @brief The resampler quality tiers with their names.
+ */
+constexpr std::pair<resampleQuality, std::string_view> resampleTiers[] =
+{
+	{ resampleQuality::best,			"best"			},
+	{ resampleQuality::medium,			"medium"		},
+	{ resampleQuality::fastest,			"fastest"		},
+	{ resampleQuality::zeroOrderHold,	"zeroOrderHold"	},
+	{ resampleQuality::linear,			"linear"		},
+	{ resampleQuality::native,			"native"		},
+};
 
+/**
+ * @brief Interleaved test signal, a sum of sines well inside the pass band of every tier.
+ */
+static std::vector<float> testSignal(const std::size_t frames, const std::size_t channels, const std::size_t sampleRate)
+{
+	std::vector<float> signal(frames * channels);
+	for (std::size_t i = 0; i < frames; i++)
+	{
+		const auto time = static_cast<double>(i) / static_cast<double>(sampleRate);
+		for (std::size_t c = 0; c < channels; c++)
+			signal[i * channels + c] = static_cast<float>(0.3 * std::sin(2.0 * std::numbers::pi * 440.0 * (c + 1) * time) + 0.2 * std::sin(2.0 * std::numbers::pi * 3000.0 * time));
+	}
+	return signal;
+}
 
+/**
+ * @brief Seconds the calling thread spends resampling one second of one channel, fed in blocks as push does.
+ * The first block is left out, it sets the converter up.
+ */
+static double costPerChannelSecond(audioResampler& resampler, const std::span<const float> signal, const std::size_t channels, const std::size_t blockFrames, const std::size_t sourceRate, const std::size_t targetRate)
+{
+	const auto block = blockFrames * channels;
+	resampler.process(signal.first(block), channels, sourceRate, targetRate);
 
+	const auto start = std::chrono::steady_clock::now();
+	for (auto offset = block; offset + block <= signal.size(); offset += block)
+		resampler.process(signal.subspan(offset, block), channels, sourceRate, targetRate);
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+	const auto channelSeconds = static_cast<double>(signal.size() - block) / static_cast<double>(sourceRate);
+	return elapsed / channelSeconds;
+}
 
+/**
+ * @brief Group delay in output frames, from the energy centroid of the response to a mono impulse against the
+ * position the impulse should have at the output rate.
+ */
+static double groupDelay(audioResampler& resampler, const std::size_t blockFrames, const std::size_t sourceRate, const std::size_t targetRate)
+{
+	constexpr std::size_t impulseFrame = 4096;
+	std::vector<float> impulse(impulseFrame * 4, 0.0f);
+	impulse[impulseFrame] = 1.0f;
 
+	double energy   = 0.0;
+	double centroid = 0.0;
+	std::size_t frame = 0;
+	for (std::size_t offset = 0; offset < impulse.size(); offset += blockFrames)
+	{
+		for (const auto sample : resampler.process(std::span(impulse).subspan(offset, std::min(blockFrames, impulse.size() - offset)), 1, sourceRate, targetRate))
+		{
+			energy   += static_cast<double>(sample) * sample;
+			centroid += static_cast<double>(sample) * sample * static_cast<double>(frame++);
+		}
+	}
+	return energy > 0.0 ? centroid / energy - static_cast<double>(impulseFrame) * static_cast<double>(targetRate) / static_cast<double>(sourceRate) : 0.0;
+}
 
+/**
+ * @brief CPU cost per channel-second and group delay of every resampler tier on the 44.1 kHz to 48 kHz conversion,
+ * with the engine audioQueue selects for that fixed ratio.
+ */
+static bool resamplerTiers()
+{
+	constexpr std::size_t channels		= 2;
+	constexpr std::size_t blockFrames	= 1024;
+	constexpr std::size_t sourceRate	= 44100;
+	constexpr std::size_t targetRate	= 48000;
+	const auto signal = testSignal(sourceRate * 10, channels, sourceRate);
 
+	for (const auto& [quality, name] : resampleTiers)
+	{
+		audioResampler timed;
+		timed.setQuality(quality);
+		const auto cost = costPerChannelSecond(timed, signal, channels, blockFrames, sourceRate, targetRate);
+		const auto engine = timed.isPolyphase() ? "polyphase" : quality == resampleQuality::native ? "interpolator" : "libsamplerate";
 
+		audioResampler delayed;
+		delayed.setQuality(quality);
+		const auto delay = groupDelay(delayed, blockFrames, sourceRate, targetRate);
 
+		std::print("resampler {:<14}{:<14}: {:8.1f} us per channel-second ({:.3f} % of a core per channel), group delay {:7.2f} frames ({:.3f} ms)\n",
+			name, engine, cost * 1e6, cost * 100.0, delay, delay * 1000.0 / targetRate);
+	}
+	return true;
+}
 
+/**
+ * @brief The polyphase engine against src_process on the ratios it takes over, for each sinc tier.
+ * The libsamplerate run is the same tier with the ratio declared variable, as under drift compensation.
+ */
+static bool polyphaseAgainstLibsamplerate()
+{
+	constexpr std::size_t channels		= 2;
+	constexpr std::size_t blockFrames	= 1024;
+	constexpr std::pair<std::size_t, std::size_t> conversions[] = { { 44100, 48000 }, { 48000, 44100 }, { 48000, 96000 }, { 96000, 48000 } };
 
+	for (const auto& [sourceRate, targetRate] : conversions)
+	{
+		const auto signal = testSignal(sourceRate * 10, channels, sourceRate);
+		for (const auto& [quality, name] : std::span(resampleTiers).first(3))
+		{
+			audioResampler polyphase;
+			polyphase.setQuality(quality);
+			const auto polyphaseCost = costPerChannelSecond(polyphase, signal, channels, blockFrames, sourceRate, targetRate);
 
+			audioResampler libsamplerate;
+			libsamplerate.setQuality(quality);
+			libsamplerate.setVariableRatio(true);
+			const auto libsamplerateCost = costPerChannelSecond(libsamplerate, signal, channels, blockFrames, sourceRate, targetRate);
 
+			if (!polyphase.isPolyphase() || libsamplerate.isPolyphase())
+			{
+				std::print("polyphase : {} -> {} {} did not run on the expected engines.\n", sourceRate, targetRate, name);
+				return false;
+			}
 
+			std::print("polyphase {:>5} -> {:>5} {:<8}: polyphase {:8.1f} us, src_process {:8.1f} us per channel-second (x{:.2f})\n",
+				sourceRate, targetRate, name, polyphaseCost * 1e6, libsamplerateCost * 1e6, libsamplerateCost / polyphaseCost);
+		}
+	}
+	return true;
+}
 
+/**
+ * @brief Stand-in for an NDI receiver. Frames are planar float like NDIlib_audio_frame_v2_t and stay owned by the
+ * receiver from capture until free, as with NDIlib_recv_capture_v3 and NDIlib_recv_free_audio_v2.
+ */
+struct mockNDIFrame
+{
+	float*	p_data;
+	int		no_samples;
+	int		no_channels;
+	int		channel_stride_in_bytes;
+	int		sample_rate;
+};
 
+class mockNDIReceiver
+{
+	private : //Class members
+		std::vector<std::vector<float>>	buffers;
+		std::vector<mockNDIFrame>			frames;
+		std::vector<bool>					captured;
+		std::size_t							next;
 
+	public : //Public member functions
+		mockNDIReceiver(const std::size_t channels, const std::size_t samples, const std::size_t count)
+			:	buffers(count), frames(count), captured(count, false), next(0)
+		{
+			// Planes are padded like NDI does, and every sample tells its buffer, channel and position apart.
+			const auto stride = samples + 16;
+			for (std::size_t b = 0; b < count; b++)
+			{
+				buffers[b].resize(stride * channels);
+				for (std::size_t c = 0; c < channels; c++)
+					for (std::size_t i = 0; i < samples; i++) buffers[b][c * stride + i] = static_cast<float>(b * 1'000'000 + c * 10'000 + i);
+				frames[b] = { buffers[b].data(), static_cast<int>(samples), static_cast<int>(channels), static_cast<int>(stride * sizeof(float)), 48000 };
+			}
+		}
 
+		mockNDIFrame* capture()
+		{
+			// Round robin over the buffers, nullptr when the next one has not been freed yet.
+			if (captured[next]) return nullptr;
+			captured[next] = true;
+			const auto frame = &frames[next];
+			next = (next + 1) % frames.size();
+			return frame;
+		}
 
+		void free(const mockNDIFrame* frame) { captured[frame - frames.data()] = false; }
 
+		std::size_t outstanding() const { return static_cast<std::size_t>(std::ranges::count(captured, true)); }
+};
 
+/**
+ * @brief Interleaved output of a frame against its planar source.
+ */
+static bool matchesFrame(const mockNDIFrame& frame, std::span<const float> interleaved)
+{
+	const auto stride = frame.channel_stride_in_bytes / sizeof(float);
+	for (std::size_t i = 0; i < static_cast<std::size_t>(frame.no_samples); i++)
+		for (std::size_t c = 0; c < static_cast<std::size_t>(frame.no_channels); c++)
+			if (interleaved[i * frame.no_channels + c] != frame.p_data[c * stride + i]) return false;
+	return true;
+}
 
+/**
+ * @brief Copying NDI input against the held layout on high channel counts, through a mock receiver.
+ * 
+ * The copying runs take each frame as NDIDirectInput does, with writePlanar into an interleaved or planar ring,
+ * and free it at once. The held run keeps the frame and frees it from the release callback. The consumer pops every
+ * frame as it arrives. The copied figure adds up the frames writePlanar and read report, the copy into the ring
+ * and the copy out of it or out of the held frame.
+ */
+static bool heldAgainstCopiedInput()
+{
+	constexpr std::size_t samples	= 1024;
+	constexpr std::size_t rounds	= 4000;
+	const auto audioSeconds = static_cast<double>(samples * rounds) / 48000.0;
 
+	for (const std::size_t channels : { 8, 32, 64 })
+	{
+		std::vector<float> output(samples * channels);
+		for (const auto layout : { sampleLayout::interleaved, sampleLayout::planar, sampleLayout::held })
+		{
+			mockNDIReceiver receiver(channels, samples, 4);
+			audioQueue<float> queue(samples * channels * 4);
+			queue.setChannelNum(channels);
+			queue.setSampleRate(48000);
+			queue.setOutputChannelNum(channels);
+			queue.setOutputSampleRate(48000);
+			queue.setLayout(layout);
+			queue.setHeldRelease([&receiver](const heldFrame<float>& frame) { receiver.free(static_cast<const mockNDIFrame*>(frame.owner)); });
 
+			mockNDIFrame* frame = nullptr;
+			std::size_t copiedFrames = 0;
+			auto passed = true;
+			const auto start = std::chrono::steady_clock::now();
+			for (std::size_t round = 0; round < rounds && passed; round++)
+			{
+				frame = receiver.capture();
+				if (!frame) { passed = false; break; }
 
+				const std::size_t stride = frame->channel_stride_in_bytes / sizeof(float);
+				if (layout == sampleLayout::held)
+					passed = queue.hold({ frame->p_data, samples, channels, stride, static_cast<std::size_t>(frame->sample_rate), frame });
+				else
+				{
+					const auto written = queue.writePlanar(frame->p_data, stride, queue.makeRoom(samples));
+					passed = written == samples;
+					copiedFrames += written;
+					receiver.free(frame);
+				}
 
+				const auto read = queue.read(output);
+				passed = passed && read == samples;
+				copiedFrames += read;
+			}
+			const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+			// The last frame is still in the receiver buffers, the mock never writes them again. Clearing the queue
+			// at shutdown hands every frame it still holds back to the receiver.
+			queue.clear();
+			if (!passed || !matchesFrame(*frame, output) || receiver.outstanding())
+			{
+				std::print("ndi : {} channels, layout {} lost or altered frames.\n", channels, static_cast<int>(layout));
+				return false;
+			}
 
+			const auto copiedBytes = static_cast<double>(copiedFrames * channels * sizeof(float));
+			std::print("ndi {:>2} channels {:<17}: {:8.1f} us per second of audio, copied {:7.2f} MB per second of audio\n",
+				channels, layout == sampleLayout::held ? "held" : layout == sampleLayout::planar ? "planar copy" : "interleaved copy",
+				elapsed / audioSeconds * 1e6, copiedBytes / audioSeconds / 1e6);
+		}
+	}
+	return true;
+}
+#pragma endregion
 
+int main(int argc, char* argv[])
+{
+	// Every test runs by default, names given on the command line select some of them.
+	struct testCase
+	{
+		std::string_view name;
+		bool (*run)();
+	};
+	constexpr testCase tests[] =
+	{
+		{ "allocations",	steadyStateAllocations			},
+		{ "resize",			deferredResize					},
+		{ "planar",			planarChannelChange				},
+		{ "dropOldest",		dropOldestReads					},
+		{ "spsc",			crossCoreThroughput				},
+		{ "resampler",		resamplerTiers					},
+		{ "polyphase",		polyphaseAgainstLibsamplerate	},
+		{ "ndi",			heldAgainstCopiedInput			},
+		{ "framePool",		framePoolAlignment				},
+		{ "kernels",		kernelsAgainstScalar			},
+		{ "jitter",			jitterGapAndLate				},
+		{ "matrix",			channelMatrixMixes				},
+		{ "mixer",			mixerSaturation					},
+		{ "gainRamp",		gainRampEndpoint				},
+	};
 
+	auto failures = 0;
+	for (const auto& test : tests)
+	{
+		if (argc > 1 && std::none_of(argv + 1, argv + argc, [&](const char* name) { return test.name == name; })) continue;
+		const auto passed = test.run();
+		std::print("{:<16}{}\n", test.name, passed ? "passed" : "FAILED");
+		failures += !passed;
+	}
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
 /* 
 